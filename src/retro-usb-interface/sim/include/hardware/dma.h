@@ -0,0 +1,65 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#pragma once
+
+// Host simulation stand-in for the Pico SDK header of the same name. Only
+// transfers to the data register of a UART are supported; they are moved
+// into the simulated TX FIFO as fast as it drains
+
+#include <cstdint>
+
+typedef struct
+{
+    bool read_increment;
+    bool write_increment;
+    bool sniff_enable;
+    unsigned dreq;
+    unsigned size;
+} dma_channel_config;
+
+enum dma_channel_transfer_size
+{
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2
+};
+
+int dma_claim_unused_channel(bool required);
+dma_channel_config dma_channel_get_default_config(unsigned channel);
+void channel_config_set_transfer_data_size(dma_channel_config* c, enum dma_channel_transfer_size size);
+void channel_config_set_read_increment(dma_channel_config* c, bool incr);
+void channel_config_set_write_increment(dma_channel_config* c, bool incr);
+void channel_config_set_dreq(dma_channel_config* c, unsigned dreq);
+void channel_config_set_sniff_enable(dma_channel_config* c, bool sniff_enable);
+void dma_channel_configure(unsigned channel, const dma_channel_config* config, volatile void* write_addr,
+    const volatile void* read_addr, unsigned transfer_count, bool trigger);
+bool dma_channel_is_busy(unsigned channel);
+void dma_channel_abort(unsigned channel);
+
+// Only CRC-16-CCITT (calculation 0x2) is supported
+void dma_sniffer_enable(unsigned channel, unsigned mode, bool force_channel_enable);
+void dma_sniffer_disable();
+void dma_sniffer_set_data_accumulator(uint32_t seed_value);
+uint32_t dma_sniffer_get_data_accumulator();
@@ -0,0 +1,38 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#pragma once
+
+// Host simulation stand-in for the Pico SDK header of the same name. Handlers
+// run on a simulator thread while it holds the interrupt lock; disabling an
+// interrupt waits for a running handler to finish
+
+#include <cstdint>
+
+typedef void (*irq_handler_t)(void);
+
+void irq_set_exclusive_handler(unsigned num, irq_handler_t handler);
+void irq_set_enabled(unsigned num, bool enabled);
+void irq_set_pending(unsigned num);
+void irq_set_priority(unsigned num, uint8_t priority);
@@ -0,0 +1,85 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#pragma once
+
+// Host simulation stand-in for the Pico SDK header of the same name. Only
+// the registers that are written by the firmware exist
+
+#include <cstddef>
+#include <cstdint>
+
+struct uart_inst
+{
+    unsigned index;
+};
+typedef struct uart_inst uart_inst_t;
+
+extern uart_inst_t sim_uart_instances[2];
+#define uart0 (&sim_uart_instances[0])
+#define uart1 (&sim_uart_instances[1])
+
+#define UART0_IRQ 20
+#define UART1_IRQ 21
+
+typedef enum
+{
+    UART_PARITY_NONE,
+    UART_PARITY_EVEN,
+    UART_PARITY_ODD
+} uart_parity_t;
+
+typedef struct
+{
+    volatile uint32_t dr;
+    volatile uint32_t fr;
+    volatile uint32_t ifls;
+    volatile uint32_t imsc;
+} uart_hw_t;
+
+#define UART_UARTFR_BUSY_BITS 0x08
+#define UART_UARTFR_RXFE_BITS 0x10
+#define UART_UARTFR_TXFF_BITS 0x20
+#define UART_UARTFR_TXFE_BITS 0x80
+#define UART_UARTIMSC_RTIM_BITS 0x40
+#define UART_UARTIMSC_TXIM_BITS 0x20
+#define UART_UARTIMSC_RXIM_BITS 0x10
+#define UART_UARTIFLS_RXIFLSEL_LSB 3
+#define UART_UARTIFLS_TXIFLSEL_LSB 0
+
+uart_hw_t* uart_get_hw(uart_inst_t* uart);
+unsigned uart_get_index(uart_inst_t* uart);
+unsigned uart_get_dreq(uart_inst_t* uart, bool is_tx);
+
+// Returns the actual baud rate, which is what the PL011 divider gives at 125MHz
+unsigned uart_init(uart_inst_t* uart, unsigned baudrate);
+void uart_deinit(uart_inst_t* uart);
+void uart_set_format(uart_inst_t* uart, unsigned data_bits, unsigned stop_bits, uart_parity_t parity);
+void uart_set_fifo_enabled(uart_inst_t* uart, bool enabled);
+void uart_set_irq_enables(uart_inst_t* uart, bool rx_has_data, bool tx_needs_data);
+bool uart_is_readable(uart_inst_t* uart);
+char uart_getc(uart_inst_t* uart);
+void uart_putc_raw(uart_inst_t* uart, char c);
+void uart_write_blocking(uart_inst_t* uart, const uint8_t* src, size_t len);
+void uart_tx_wait_blocking(uart_inst_t* uart);
@@ -0,0 +1,136 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#pragma once
+
+/*
+ * Host simulation stand-in for the part of the TinyUSB host API that the
+ * firmware uses. There is a mass storage device at address 1, with a LUN per
+ * disk image, and a boot protocol mouse at address 2 if the simulator reads
+ * mouse input. Everything, including the callbacks, runs from tuh_task().
+ */
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+
+#define BOARD_TUH_RHPORT 0
+
+static inline uint32_t tu_ntohl(uint32_t v)
+{
+    return __builtin_bswap32(v);
+}
+
+static inline uint32_t tu_htonl(uint32_t v)
+{
+    return __builtin_bswap32(v);
+}
+
+bool tuh_init(uint8_t rhport);
+void tuh_task();
+
+// Mass storage
+
+typedef struct
+{
+    uint32_t signature;
+    uint32_t tag;
+    uint32_t total_bytes;
+    uint8_t dir;
+    uint8_t lun;
+    uint8_t cmd_len;
+    uint8_t command[16];
+} msc_cbw_t;
+
+typedef struct
+{
+    uint32_t signature;
+    uint32_t tag;
+    uint32_t data_residue;
+    uint8_t status;
+} msc_csw_t;
+
+enum
+{
+    MSC_CSW_STATUS_PASSED = 0,
+    MSC_CSW_STATUS_FAILED,
+    MSC_CSW_STATUS_PHASE_ERROR
+};
+
+typedef struct
+{
+    msc_cbw_t const* cbw;
+    msc_csw_t const* csw;
+    void* scsi_data;
+    uintptr_t user_arg;
+} tuh_msc_complete_data_t;
+
+typedef bool (*tuh_msc_complete_cb_t)(uint8_t dev_addr, tuh_msc_complete_data_t const* cb_data);
+
+// Big endian, as on the wire
+typedef struct
+{
+    uint32_t last_lba;
+    uint32_t block_size;
+} scsi_read_capacity10_resp_t;
+
+bool tuh_msc_mounted(uint8_t dev_addr);
+bool tuh_msc_ready(uint8_t dev_addr);
+uint8_t tuh_msc_get_maxlun(uint8_t dev_addr);
+uint32_t tuh_msc_get_block_count(uint8_t dev_addr, uint8_t lun);
+uint32_t tuh_msc_get_block_size(uint8_t dev_addr, uint8_t lun);
+bool tuh_msc_read_capacity(uint8_t dev_addr, uint8_t lun, scsi_read_capacity10_resp_t* response, tuh_msc_complete_cb_t complete_cb, uintptr_t arg);
+bool tuh_msc_read10(uint8_t dev_addr, uint8_t lun, void* buffer, uint32_t lba, uint16_t block_count, tuh_msc_complete_cb_t complete_cb, uintptr_t arg);
+bool tuh_msc_write10(uint8_t dev_addr, uint8_t lun, void const* buffer, uint32_t lba, uint16_t block_count, tuh_msc_complete_cb_t complete_cb, uintptr_t arg);
+
+// HID
+
+#define HID_ITF_PROTOCOL_NONE 0
+#define HID_ITF_PROTOCOL_KEYBOARD 1
+#define HID_ITF_PROTOCOL_MOUSE 2
+
+#define MOUSE_BUTTON_LEFT 0x01
+#define MOUSE_BUTTON_RIGHT 0x02
+#define MOUSE_BUTTON_MIDDLE 0x04
+
+typedef struct __attribute__((packed))
+{
+    uint8_t buttons;
+    int8_t x;
+    int8_t y;
+    int8_t wheel;
+    int8_t pan;
+} hid_mouse_report_t;
+
+uint8_t tuh_hid_interface_protocol(uint8_t dev_addr, uint8_t instance);
+bool tuh_hid_receive_report(uint8_t dev_addr, uint8_t instance);
+
+// Implemented by the firmware
+extern "C" {
+void tuh_msc_mount_cb(uint8_t dev_addr);
+void tuh_msc_umount_cb(uint8_t dev_addr);
+void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* desc_report, uint16_t desc_len);
+void tuh_hid_umount_cb(uint8_t dev_addr, uint8_t instance);
+void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len);
+}
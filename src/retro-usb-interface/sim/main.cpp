@@ -0,0 +1,115 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include "sim.h"
+
+// main() of the firmware, renamed by CMakeLists.txt
+int firmware_main();
+
+namespace
+{
+    void Usage(const char* program)
+    {
+        fprintf(stderr,
+            "usage: %s [options] image...\n"
+            "\n"
+            "Runs the firmware with uart1 on a pseudo-terminal, and each disk image as a\n"
+            "LUN of a USB mass storage device. The debug console is on stdin/stdout.\n"
+            "\n"
+            "  --block-size BYTES   USB block size of the images (512)\n"
+            "  --usb-latency US     duration of every mass storage command (1000)\n"
+            "  --read-only          fail all writes, like a write-protected medium\n"
+            "  --mouse PATH         read mouse reports, \"dx dy buttons [wheel]\" per line\n"
+            "  --mouse-interval US  minimum time between mouse reports (8000)\n"
+            "  --link PATH          create a symlink to the pseudo-terminal\n"
+            "\n"
+            "SIGUSR1 pulses DTR, like a PC resetting a serial mouse.\n",
+            program);
+    }
+
+    void OnDtrSignal(int)
+    {
+        sim::PulseDtr();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    enum { BlockSize = 256, UsbLatency, ReadOnly, Mouse, MouseInterval, Link };
+    static const option longOptions[] = {
+        { "block-size", required_argument, nullptr, BlockSize },
+        { "usb-latency", required_argument, nullptr, UsbLatency },
+        { "read-only", no_argument, nullptr, ReadOnly },
+        { "mouse", required_argument, nullptr, Mouse },
+        { "mouse-interval", required_argument, nullptr, MouseInterval },
+        { "link", required_argument, nullptr, Link },
+        { "help", no_argument, nullptr, 'h' },
+        { nullptr, 0, nullptr, 0 }
+    };
+
+    sim::Options options;
+    int opt;
+    while((opt = getopt_long(argc, argv, "h", longOptions, nullptr)) != -1) {
+        switch(opt) {
+            case BlockSize:
+                options.blockSize = strtoul(optarg, nullptr, 0);
+                break;
+            case UsbLatency:
+                options.usbLatency_us = strtoul(optarg, nullptr, 0);
+                break;
+            case ReadOnly:
+                options.readOnly = true;
+                break;
+            case Mouse:
+                options.mouse = optarg;
+                break;
+            case MouseInterval:
+                options.mouseInterval_us = strtoul(optarg, nullptr, 0);
+                break;
+            case Link:
+                options.link = optarg;
+                break;
+            default:
+                Usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    for(int n = optind; n < argc; ++n) {
+        options.images.push_back(argv[n]);
+    }
+    if (options.blockSize == 0 || options.blockSize % 512 != 0) {
+        fprintf(stderr, "%s: block size must be a multiple of 512\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    if (!sim::StartUsbHost(options) || !sim::StartUart(options)) return EXIT_FAILURE;
+    sim::StartConsole();
+    std::signal(SIGUSR1, OnDtrSignal);
+    return firmware_main();
+}
@@ -0,0 +1,281 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "sim.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/pio.h"
+#include "bsp/board.h"
+
+namespace
+{
+    const auto startTime = std::chrono::steady_clock::now();
+    thread_local unsigned coreNum = 0;
+
+    struct Interrupt
+    {
+        irq_handler_t handler{};
+        bool enabled{};
+        bool pending{};
+    };
+    // Held while a handler runs, and between save_and_disable_interrupts()
+    // and restore_interrupts()
+    std::recursive_mutex interruptLock;
+    std::array<Interrupt, 32> interrupts;
+
+    // GPIO of pin::DTR in serial.cpp
+    static constexpr auto inline DtrPin = 3;
+    static constexpr auto inline DtrPulse_us = 100'000;
+    std::atomic<uint64_t> dtrLowUntil_us{};
+
+    bool consoleClosed = false;
+    termios savedTermios{};
+
+    void RestoreConsole()
+    {
+        tcsetattr(STDIN_FILENO, TCSANOW, &savedTermios);
+    }
+
+    void OnTerminate(int)
+    {
+        RestoreConsole();
+        _exit(0);
+    }
+}
+
+namespace sim
+{
+    void SetCoreNum(unsigned core)
+    {
+        coreNum = core;
+    }
+
+    // Keys go to the debug console right away, without echo
+    void StartConsole()
+    {
+        if (!isatty(STDIN_FILENO)) return;
+        tcgetattr(STDIN_FILENO, &savedTermios);
+        auto t = savedTermios;
+        t.c_lflag &= ~(ICANON | ECHO);
+        tcsetattr(STDIN_FILENO, TCSANOW, &t);
+        std::atexit(RestoreConsole);
+        std::signal(SIGINT, OnTerminate);
+        std::signal(SIGTERM, OnTerminate);
+    }
+
+    void DispatchInterrupts()
+    {
+        std::lock_guard lock{ interruptLock };
+        for(auto& interrupt: interrupts) {
+            if (!interrupt.pending || !interrupt.enabled || !interrupt.handler) continue;
+            interrupt.pending = false;
+            interrupt.handler();
+        }
+    }
+
+    void PulseDtr()
+    {
+        dtrLowUntil_us = time_us_64() + DtrPulse_us;
+    }
+}
+
+unsigned get_core_num()
+{
+    return coreNum;
+}
+
+int getchar_timeout_us(uint32_t timeout_us)
+{
+    if (consoleClosed) return PICO_ERROR_TIMEOUT;
+    pollfd pfd{ .fd = STDIN_FILENO, .events = POLLIN };
+    if (poll(&pfd, 1, static_cast<int>(timeout_us / 1'000)) <= 0) return PICO_ERROR_TIMEOUT;
+    uint8_t ch;
+    if (read(STDIN_FILENO, &ch, 1) != 1) {
+        consoleClosed = true;
+        return PICO_ERROR_TIMEOUT;
+    }
+    return ch;
+}
+
+void board_init()
+{
+}
+
+// Time
+
+absolute_time_t get_absolute_time()
+{
+    return time_us_64();
+}
+
+uint32_t to_ms_since_boot(absolute_time_t t)
+{
+    return static_cast<uint32_t>(t / 1'000);
+}
+
+uint64_t to_us_since_boot(absolute_time_t t)
+{
+    return t;
+}
+
+uint64_t time_us_64()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+uint32_t time_us_32()
+{
+    return static_cast<uint32_t>(time_us_64());
+}
+
+void sleep_us(uint64_t us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void sleep_ms(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void busy_wait_us(uint64_t us)
+{
+    const auto until = time_us_64() + us;
+    while(time_us_64() < until) {
+    }
+}
+
+void busy_wait_us_32(uint32_t us)
+{
+    busy_wait_us(us);
+}
+
+// GPIO
+
+void gpio_init(unsigned)
+{
+}
+
+void gpio_set_dir(unsigned, bool)
+{
+}
+
+void gpio_set_function(unsigned, gpio_function)
+{
+}
+
+void gpio_pull_up(unsigned)
+{
+}
+
+bool gpio_get(unsigned gpio)
+{
+    if (gpio == DtrPin) return time_us_64() >= dtrLowUntil_us;
+    return true;
+}
+
+void gpio_put(unsigned, bool)
+{
+}
+
+// PIO
+
+int pio_claim_unused_sm(PIO, bool)
+{
+    return 0;
+}
+
+uint pio_add_program(PIO, const pio_program_t*)
+{
+    return 0;
+}
+
+void pio_sm_put(PIO, uint, uint32_t)
+{
+}
+
+uint32_t pio_sm_get(PIO, uint)
+{
+    return 0;
+}
+
+bool pio_sm_is_rx_fifo_empty(PIO, uint)
+{
+    return true;
+}
+
+// Interrupts
+
+void irq_set_exclusive_handler(unsigned num, irq_handler_t handler)
+{
+    std::lock_guard lock{ interruptLock };
+    interrupts[num].handler = handler;
+}
+
+void irq_set_enabled(unsigned num, bool enabled)
+{
+    std::lock_guard lock{ interruptLock };
+    interrupts[num].enabled = enabled;
+}
+
+void irq_set_pending(unsigned num)
+{
+    std::lock_guard lock{ interruptLock };
+    interrupts[num].pending = true;
+}
+
+void irq_set_priority(unsigned, uint8_t)
+{
+}
+
+uint32_t save_and_disable_interrupts()
+{
+    interruptLock.lock();
+    return 0;
+}
+
+void restore_interrupts(uint32_t)
+{
+    interruptLock.unlock();
+}
+
+// Cores
+
+void multicore_launch_core1(void (*entry)(void))
+{
+    std::thread([entry] {
+        sim::SetCoreNum(1);
+        entry();
+    }).detach();
+}
@@ -0,0 +1,62 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sim
+{
+    struct Options
+    {
+        // One LUN of the mass storage device per image
+        std::vector<std::string> images;
+        uint32_t blockSize = 512;
+        // Time taken by every mass storage command
+        uint32_t usbLatency_us = 1'000;
+        // Fail all writes, like a write-protected medium
+        bool readOnly{};
+        // Mouse reports, one "dx dy buttons" line each; none if empty
+        std::string mouse;
+        uint32_t mouseInterval_us = 8'000;
+        // Symlink to create to the pseudo-terminal of uart1
+        std::string link;
+    };
+
+    // platform.cpp
+    void SetCoreNum(unsigned core);
+    void StartConsole();
+    // Runs the handlers of all interrupts that are pending and enabled
+    void DispatchInterrupts();
+    // Pulses pin::DTR low, as a PC does to reset a serial mouse
+    void PulseDtr();
+
+    // uart.cpp
+    bool StartUart(const Options& options);
+
+    // usbhost.cpp
+    bool StartUsbHost(const Options& options);
+}
@@ -0,0 +1,452 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "sim.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include "crc16.h"
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+
+/*
+ * uart1 is a pseudo-terminal. Bytes move between the terminal and the
+ * simulated FIFOs at the configured baud rate, so transfer times are close to
+ * those of the real serial line; the baud rate the client sets on its end is
+ * ignored. The RX interrupt is raised like the PL011 does: at the FIFO level
+ * selected by UARTIFLS, or after 32 idle bit periods.
+ */
+uart_inst_t sim_uart_instances[2]{ { 0 }, { 1 } };
+
+namespace
+{
+    static constexpr auto inline ClockPeri = 125'000'000;
+    static constexpr auto inline FifoDepth = 32;
+    static constexpr auto inline RxTimeoutBits = 32;
+    static constexpr auto inline Tick = std::chrono::microseconds(100);
+    static constexpr auto inline NoChannel = -1;
+    static constexpr auto inline SnifferCRC16 = 0x2;
+
+    struct Uart
+    {
+        std::mutex mutex;
+        uart_hw_t hw{};
+        unsigned baudrate = 115'200;
+        unsigned bitsPerByte = 10;
+        bool fifoEnabled = true;
+        // Received from the terminal, but still on the line
+        std::deque<uint8_t> rxLine;
+        std::deque<uint8_t> rxFifo;
+        // TX FIFO, followed by what DMA has not moved into it yet
+        std::deque<uint8_t> tx;
+        uint64_t rxNext_ns{};
+        uint64_t rxLast_ns{};
+        uint64_t txNext_ns{};
+        int dmaChannel = NoChannel;
+        std::atomic<uint32_t> overruns{};
+
+        size_t Depth() const
+        {
+            return fifoEnabled ? FifoDepth : 1;
+        }
+
+        uint64_t ByteTime_ns() const
+        {
+            return static_cast<uint64_t>(bitsPerByte) * 1'000'000'000 / baudrate;
+        }
+    };
+    Uart uart;
+    uart_hw_t uart0Hw;
+    int master = -1;
+    int slave = -1;
+
+    int nextDmaChannel = 0;
+    struct Sniffer
+    {
+        int channel = NoChannel;
+        uint32_t accumulator{};
+    };
+    Sniffer sniffer;
+
+    uint64_t Now_ns()
+    {
+        return time_us_64() * 1'000;
+    }
+
+    template<typename Predicate>
+    void WaitFor(Predicate predicate)
+    {
+        while(true) {
+            {
+                std::lock_guard lock{ uart.mutex };
+                if (predicate()) return;
+            }
+            std::this_thread::sleep_for(Tick);
+        }
+    }
+
+    // Moves bytes along the line; returns true if the RX interrupt is due.
+    // With stopWhenFull, bytes that do not fit in the RX FIFO stay on the
+    // line, so the interrupt handler can make room first; otherwise they are
+    // lost
+    bool Advance(std::vector<uint8_t>& sent, bool stopWhenFull)
+    {
+        std::lock_guard lock{ uart.mutex };
+        const auto now = Now_ns();
+        const auto byteTime = uart.ByteTime_ns();
+
+        if (uart.rxLine.empty()) uart.rxNext_ns = now + byteTime;
+        // When the host was late to run this thread, the line resumes where
+        // it stopped; catching up at once would overrun the RX FIFO before
+        // the interrupt handler had a chance to empty it
+        const auto resume = now - std::chrono::nanoseconds(Tick).count();
+        if (uart.rxNext_ns < resume) uart.rxNext_ns = resume;
+        while(!uart.rxLine.empty() && uart.rxNext_ns <= now) {
+            if (stopWhenFull && uart.rxFifo.size() >= uart.Depth()) break;
+            if (uart.rxFifo.size() < uart.Depth()) {
+                uart.rxFifo.push_back(uart.rxLine.front());
+            } else {
+                ++uart.overruns;
+            }
+            uart.rxLine.pop_front();
+            uart.rxLast_ns = uart.rxNext_ns;
+            uart.rxNext_ns += byteTime;
+        }
+
+        if (uart.tx.empty()) uart.txNext_ns = now + byteTime;
+        while(!uart.tx.empty() && uart.txNext_ns <= now) {
+            sent.push_back(uart.tx.front());
+            uart.tx.pop_front();
+            uart.txNext_ns += byteTime;
+        }
+
+        if (uart.rxFifo.empty()) return false;
+        static constexpr std::array<size_t, 5> levels{ 4, 8, 16, 24, 28 };
+        const auto level = uart.fifoEnabled ? levels[std::min<size_t>((uart.hw.ifls >> UART_UARTIFLS_RXIFLSEL_LSB) & 7, 4)] : 1;
+        if ((uart.hw.imsc & UART_UARTIMSC_RXIM_BITS) && uart.rxFifo.size() >= level) return true;
+        return (uart.hw.imsc & UART_UARTIMSC_RTIM_BITS) && now - uart.rxLast_ns >= RxTimeoutBits * byteTime / uart.bitsPerByte;
+    }
+
+    size_t RxFifoLevel()
+    {
+        std::lock_guard lock{ uart.mutex };
+        return uart.rxFifo.size();
+    }
+
+    void RunLine()
+    {
+        sim::SetCoreNum(0);
+        std::vector<uint8_t> sent;
+        uint32_t reportedOverruns = 0;
+        while(true) {
+            std::this_thread::sleep_for(Tick);
+
+            std::array<uint8_t, 256> received;
+            const auto length = read(master, received.data(), received.size());
+            if (length > 0) {
+                std::lock_guard lock{ uart.mutex };
+                uart.rxLine.insert(uart.rxLine.end(), received.begin(), received.begin() + length);
+            }
+
+            // A tick spans several byte times. On the RP2040, the handler
+            // empties the RX FIFO within a byte time of the interrupt, so it
+            // gets to run whenever the FIFO fills up during the tick; that
+            // matters without the FIFOs, as the FIFO then holds a single byte.
+            // Bytes are only lost if the handler does not make room
+            sent.clear();
+            for(auto interrupt = Advance(sent, true); interrupt; interrupt = Advance(sent, true)) {
+                const auto before = RxFifoLevel();
+                irq_set_pending(UART1_IRQ);
+                sim::DispatchInterrupts();
+                if (RxFifoLevel() >= before) break;
+            }
+            if (Advance(sent, false)) irq_set_pending(UART1_IRQ);
+            if (!sent.empty()) {
+                // Without a reader, the terminal fills up and bytes are lost, as on a real line
+                [[maybe_unused]] const auto written = write(master, sent.data(), sent.size());
+            }
+            sim::DispatchInterrupts();
+
+            if (const uint32_t overruns = uart.overruns; overruns != reportedOverruns) {
+                printf("sim: uart1 RX overrun, %lu bytes lost\n", static_cast<unsigned long>(overruns - reportedOverruns));
+                reportedOverruns = overruns;
+            }
+        }
+    }
+
+    bool IsSimulated(uart_inst_t* u)
+    {
+        return u == uart1;
+    }
+}
+
+namespace sim
+{
+    bool StartUart(const Options& options)
+    {
+        master = posix_openpt(O_RDWR | O_NOCTTY);
+        if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+            perror("sim: cannot create pseudo-terminal");
+            return false;
+        }
+        const std::string name = ptsname(master);
+        // Keeps the terminal usable while no client has it open. Clients
+        // should flush their input when opening it, to skip stale output
+        slave = open(name.c_str(), O_RDWR | O_NOCTTY);
+        if (slave < 0) {
+            perror("sim: cannot open pseudo-terminal");
+            return false;
+        }
+        termios t;
+        tcgetattr(slave, &t);
+        cfmakeraw(&t);
+        tcsetattr(slave, TCSANOW, &t);
+        fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+
+        if (!options.link.empty()) {
+            unlink(options.link.c_str());
+            if (symlink(name.c_str(), options.link.c_str()) < 0) {
+                perror("sim: cannot create link to pseudo-terminal");
+                return false;
+            }
+        }
+        printf("sim: uart1 is %s\n", options.link.empty() ? name.c_str() : options.link.c_str());
+
+        std::thread(RunLine).detach();
+        return true;
+    }
+}
+
+// UART
+
+uart_hw_t* uart_get_hw(uart_inst_t* u)
+{
+    return IsSimulated(u) ? &uart.hw : &uart0Hw;
+}
+
+unsigned uart_get_index(uart_inst_t* u)
+{
+    return u->index;
+}
+
+unsigned uart_get_dreq(uart_inst_t* u, bool is_tx)
+{
+    // DREQ_UART0_TX is 20, followed by RX and then uart1
+    return 20 + u->index * 2 + (is_tx ? 0 : 1);
+}
+
+unsigned uart_init(uart_inst_t* u, unsigned baudrate)
+{
+    const auto divider = 8 * ClockPeri / baudrate;
+    auto integer = divider >> 7;
+    auto fraction = ((divider & 0x7f) + 1) / 2;
+    if (integer == 0) {
+        integer = 1;
+        fraction = 0;
+    } else if (integer >= 0xffff) {
+        integer = 0xffff;
+        fraction = 0;
+    }
+    const auto actual = (4 * ClockPeri) / (64 * integer + fraction);
+    if (!IsSimulated(u)) return actual;
+
+    std::lock_guard lock{ uart.mutex };
+    uart.hw = {};
+    uart.baudrate = actual;
+    uart.bitsPerByte = 10;
+    uart.fifoEnabled = true;
+    uart.rxFifo.clear();
+    uart.tx.clear();
+    uart.dmaChannel = NoChannel;
+    return actual;
+}
+
+void uart_deinit(uart_inst_t*)
+{
+}
+
+void uart_set_format(uart_inst_t* u, unsigned data_bits, unsigned stop_bits, uart_parity_t parity)
+{
+    if (!IsSimulated(u)) return;
+    std::lock_guard lock{ uart.mutex };
+    uart.bitsPerByte = 1 + data_bits + stop_bits + (parity != UART_PARITY_NONE ? 1 : 0);
+}
+
+void uart_set_fifo_enabled(uart_inst_t* u, bool enabled)
+{
+    if (!IsSimulated(u)) return;
+    std::lock_guard lock{ uart.mutex };
+    uart.fifoEnabled = enabled;
+}
+
+void uart_set_irq_enables(uart_inst_t* u, bool rx_has_data, bool tx_needs_data)
+{
+    if (!IsSimulated(u)) return;
+    std::lock_guard lock{ uart.mutex };
+    uart.hw.ifls = 0;
+    uart.hw.imsc = (rx_has_data ? UART_UARTIMSC_RXIM_BITS | UART_UARTIMSC_RTIM_BITS : 0) |
+        (tx_needs_data ? UART_UARTIMSC_TXIM_BITS : 0);
+}
+
+bool uart_is_readable(uart_inst_t* u)
+{
+    if (!IsSimulated(u)) return false;
+    std::lock_guard lock{ uart.mutex };
+    return !uart.rxFifo.empty();
+}
+
+char uart_getc(uart_inst_t* u)
+{
+    assert(IsSimulated(u));
+    WaitFor([] { return !uart.rxFifo.empty(); });
+    std::lock_guard lock{ uart.mutex };
+    const auto ch = uart.rxFifo.front();
+    uart.rxFifo.pop_front();
+    return static_cast<char>(ch);
+}
+
+void uart_write_blocking(uart_inst_t* u, const uint8_t* src, size_t len)
+{
+    if (!IsSimulated(u)) return;
+    for(size_t n = 0; n < len; ++n) {
+        WaitFor([] { return uart.tx.size() < uart.Depth(); });
+        std::lock_guard lock{ uart.mutex };
+        uart.tx.push_back(src[n]);
+    }
+}
+
+void uart_putc_raw(uart_inst_t* u, char c)
+{
+    const auto byte = static_cast<uint8_t>(c);
+    uart_write_blocking(u, &byte, 1);
+}
+
+void uart_tx_wait_blocking(uart_inst_t* u)
+{
+    if (!IsSimulated(u)) return;
+    WaitFor([] { return uart.tx.empty(); });
+}
+
+// DMA
+
+int dma_claim_unused_channel(bool required)
+{
+    if (nextDmaChannel == 12) {
+        if (required) std::abort();
+        return -1;
+    }
+    return nextDmaChannel++;
+}
+
+dma_channel_config dma_channel_get_default_config(unsigned)
+{
+    return { .read_increment = true, .write_increment = false, .sniff_enable = false, .dreq = 0x3f, .size = DMA_SIZE_32 };
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config* c, dma_channel_transfer_size size)
+{
+    c->size = size;
+}
+
+void channel_config_set_read_increment(dma_channel_config* c, bool incr)
+{
+    c->read_increment = incr;
+}
+
+void channel_config_set_write_increment(dma_channel_config* c, bool incr)
+{
+    c->write_increment = incr;
+}
+
+void channel_config_set_dreq(dma_channel_config* c, unsigned dreq)
+{
+    c->dreq = dreq;
+}
+
+void channel_config_set_sniff_enable(dma_channel_config* c, bool sniff_enable)
+{
+    c->sniff_enable = sniff_enable;
+}
+
+void dma_channel_configure(unsigned channel, const dma_channel_config* config, volatile void* write_addr,
+    const volatile void* read_addr, unsigned transfer_count, bool trigger)
+{
+    if (write_addr != &uart.hw.dr || config->size != DMA_SIZE_8 || !config->read_increment || !trigger) {
+        fprintf(stderr, "sim: unsupported DMA transfer on channel %u\n", channel);
+        std::abort();
+    }
+    const auto data = const_cast<const uint8_t*>(static_cast<const volatile uint8_t*>(read_addr));
+    if (config->sniff_enable && sniffer.channel == static_cast<int>(channel)) {
+        sniffer.accumulator = crc16::Update(static_cast<uint16_t>(sniffer.accumulator), data, transfer_count);
+    }
+    std::lock_guard lock{ uart.mutex };
+    uart.tx.insert(uart.tx.end(), data, data + transfer_count);
+    uart.dmaChannel = channel;
+}
+
+bool dma_channel_is_busy(unsigned channel)
+{
+    std::lock_guard lock{ uart.mutex };
+    return uart.dmaChannel == static_cast<int>(channel) && uart.tx.size() > uart.Depth();
+}
+
+void dma_channel_abort(unsigned channel)
+{
+    std::lock_guard lock{ uart.mutex };
+    if (uart.dmaChannel != static_cast<int>(channel)) return;
+    // What is in the FIFO already still goes out
+    if (uart.tx.size() > uart.Depth()) uart.tx.resize(uart.Depth());
+    uart.dmaChannel = NoChannel;
+}
+
+void dma_sniffer_enable(unsigned channel, unsigned mode, bool)
+{
+    assert(mode == SnifferCRC16);
+    sniffer.channel = channel;
+}
+
+void dma_sniffer_disable()
+{
+    sniffer.channel = NoChannel;
+}
+
+void dma_sniffer_set_data_accumulator(uint32_t seed_value)
+{
+    sniffer.accumulator = seed_value;
+}
+
+uint32_t dma_sniffer_get_data_accumulator()
+{
+    return sniffer.accumulator;
+}
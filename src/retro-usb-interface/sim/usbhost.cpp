@@ -0,0 +1,253 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "sim.h"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "pico/stdlib.h"
+#include "tusb.h"
+
+/*
+ * Fake USB host: a mass storage device with a LUN per disk image and,
+ * optionally, a boot protocol mouse. Commands complete after a fixed latency;
+ * like TinyUSB, only one mass storage command can be in progress at a time.
+ */
+namespace
+{
+    static constexpr uint8_t inline MscAddress = 1;
+    static constexpr uint8_t inline HidAddress = 2;
+
+    sim::Options options;
+
+    struct Lun
+    {
+        int fd = -1;
+        uint32_t blockCount{};
+    };
+    std::vector<Lun> luns;
+
+    enum class Operation { ReadCapacity, Read, Write };
+    struct Command
+    {
+        Operation op;
+        uint8_t lun;
+        void* buffer;
+        uint32_t lba;
+        uint16_t blocks;
+        tuh_msc_complete_cb_t complete_cb;
+        uintptr_t arg;
+        uint64_t due_us;
+    };
+    std::optional<Command> command;
+
+    bool mounted = false;
+
+    int mouseFd = -1;
+    bool reportRequested = false;
+    uint64_t nextReport_us{};
+    std::string mouseInput;
+    hid_mouse_report_t report{};
+
+    bool Issue(uint8_t dev_addr, uint8_t lun, Operation op, void* buffer, uint32_t lba, uint16_t blocks, tuh_msc_complete_cb_t complete_cb, uintptr_t arg)
+    {
+        if (!tuh_msc_ready(dev_addr) || lun >= luns.size()) return false;
+        command = { op, lun, buffer, lba, blocks, complete_cb, arg, time_us_64() + options.usbLatency_us };
+        return true;
+    }
+
+    bool Execute(const Command& cmd)
+    {
+        auto& unit = luns[cmd.lun];
+        if (cmd.op == Operation::ReadCapacity) {
+            auto response = static_cast<scsi_read_capacity10_resp_t*>(cmd.buffer);
+            response->last_lba = tu_htonl(unit.blockCount - 1);
+            response->block_size = tu_htonl(options.blockSize);
+            return true;
+        }
+        if (cmd.lba >= unit.blockCount || unit.blockCount - cmd.lba < cmd.blocks) return false;
+        const auto offset = static_cast<off_t>(cmd.lba) * options.blockSize;
+        const auto length = static_cast<size_t>(cmd.blocks) * options.blockSize;
+        if (cmd.op == Operation::Read) {
+            return pread(unit.fd, cmd.buffer, length, offset) == static_cast<ssize_t>(length);
+        }
+        return pwrite(unit.fd, cmd.buffer, length, offset) == static_cast<ssize_t>(length);
+    }
+
+    void Complete()
+    {
+        const auto cmd = *command;
+        command.reset();
+        const msc_cbw_t cbw{ .lun = cmd.lun };
+        const msc_csw_t csw{ .status = static_cast<uint8_t>(Execute(cmd) ? MSC_CSW_STATUS_PASSED : MSC_CSW_STATUS_FAILED) };
+        const tuh_msc_complete_data_t data{ .cbw = &cbw, .csw = &csw, .scsi_data = cmd.buffer, .user_arg = cmd.arg };
+        cmd.complete_cb(MscAddress, &data);
+    }
+
+    // Parses the next "dx dy buttons [wheel]" line, if there is a complete one
+    std::optional<hid_mouse_report_t> NextMouseReport()
+    {
+        std::array<char, 256> buffer;
+        const auto length = read(mouseFd, buffer.data(), buffer.size());
+        if (length > 0) mouseInput.append(buffer.data(), length);
+
+        while(true) {
+            const auto eol = mouseInput.find('\n');
+            if (eol == std::string::npos) return {};
+            const auto line = mouseInput.substr(0, eol);
+            mouseInput.erase(0, eol + 1);
+
+            int dx, dy, wheel = 0;
+            unsigned buttons = 0;
+            if (sscanf(line.c_str(), "%d %d %u %d", &dx, &dy, &buttons, &wheel) < 2) continue;
+            return hid_mouse_report_t{
+                .buttons = static_cast<uint8_t>(buttons),
+                .x = static_cast<int8_t>(std::clamp(dx, -127, 127)),
+                .y = static_cast<int8_t>(std::clamp(dy, -127, 127)),
+                .wheel = static_cast<int8_t>(std::clamp(wheel, -127, 127)),
+            };
+        }
+    }
+}
+
+namespace sim
+{
+    bool StartUsbHost(const Options& opts)
+    {
+        options = opts;
+        for(const auto& image: options.images) {
+            const auto fd = open(image.c_str(), options.readOnly ? O_RDONLY : O_RDWR);
+            struct stat st;
+            if (fd < 0 || fstat(fd, &st) < 0) {
+                perror(image.c_str());
+                return false;
+            }
+            const auto blocks = static_cast<uint64_t>(st.st_size) / options.blockSize;
+            if (blocks == 0 || blocks > UINT32_MAX) {
+                fprintf(stderr, "sim: %s: size must be between 1 and 2^32 blocks of %lu bytes\n", image.c_str(), static_cast<unsigned long>(options.blockSize));
+                return false;
+            }
+            luns.push_back({ fd, static_cast<uint32_t>(blocks) });
+            printf("sim: LUN %zu is %s, %lu blocks\n", luns.size() - 1, image.c_str(), static_cast<unsigned long>(blocks));
+        }
+
+        if (!options.mouse.empty()) {
+            // Non-blocking, so that opening a FIFO does not wait for a writer
+            mouseFd = open(options.mouse.c_str(), O_RDONLY | O_NONBLOCK);
+            if (mouseFd < 0) {
+                perror(options.mouse.c_str());
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+bool tuh_init(uint8_t)
+{
+    return true;
+}
+
+void tuh_task()
+{
+    if (!mounted) {
+        mounted = true;
+        if (!luns.empty()) tuh_msc_mount_cb(MscAddress);
+        if (mouseFd >= 0) tuh_hid_mount_cb(HidAddress, 0, nullptr, 0);
+    }
+
+    const auto now = time_us_64();
+    if (command && now >= command->due_us) Complete();
+
+    if (reportRequested && now >= nextReport_us) {
+        if (const auto next = NextMouseReport(); next) {
+            report = *next;
+            reportRequested = false;
+            nextReport_us = now + options.mouseInterval_us;
+            tuh_hid_report_received_cb(HidAddress, 0, reinterpret_cast<const uint8_t*>(&report), sizeof(report));
+        }
+    }
+    std::this_thread::yield();
+}
+
+bool tuh_msc_mounted(uint8_t dev_addr)
+{
+    return mounted && dev_addr == MscAddress && !luns.empty();
+}
+
+bool tuh_msc_ready(uint8_t dev_addr)
+{
+    return tuh_msc_mounted(dev_addr) && !command;
+}
+
+uint8_t tuh_msc_get_maxlun(uint8_t)
+{
+    return static_cast<uint8_t>(luns.size());
+}
+
+uint32_t tuh_msc_get_block_count(uint8_t, uint8_t lun)
+{
+    return lun < luns.size() ? luns[lun].blockCount : 0;
+}
+
+uint32_t tuh_msc_get_block_size(uint8_t, uint8_t)
+{
+    return options.blockSize;
+}
+
+bool tuh_msc_read_capacity(uint8_t dev_addr, uint8_t lun, scsi_read_capacity10_resp_t* response, tuh_msc_complete_cb_t complete_cb, uintptr_t arg)
+{
+    return Issue(dev_addr, lun, Operation::ReadCapacity, response, 0, 0, complete_cb, arg);
+}
+
+bool tuh_msc_read10(uint8_t dev_addr, uint8_t lun, void* buffer, uint32_t lba, uint16_t block_count, tuh_msc_complete_cb_t complete_cb, uintptr_t arg)
+{
+    return Issue(dev_addr, lun, Operation::Read, buffer, lba, block_count, complete_cb, arg);
+}
+
+bool tuh_msc_write10(uint8_t dev_addr, uint8_t lun, void const* buffer, uint32_t lba, uint16_t block_count, tuh_msc_complete_cb_t complete_cb, uintptr_t arg)
+{
+    return Issue(dev_addr, lun, Operation::Write, const_cast<void*>(buffer), lba, block_count, complete_cb, arg);
+}
+
+uint8_t tuh_hid_interface_protocol(uint8_t dev_addr, uint8_t)
+{
+    return dev_addr == HidAddress ? HID_ITF_PROTOCOL_MOUSE : HID_ITF_PROTOCOL_NONE;
+}
+
+bool tuh_hid_receive_report(uint8_t dev_addr, uint8_t)
+{
+    if (dev_addr != HidAddress) return false;
+    reportRequested = true;
+    return true;
+}
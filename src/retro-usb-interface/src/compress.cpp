@@ -0,0 +1,239 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "compress.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+namespace compress
+{
+    namespace
+    {
+        static constexpr auto inline MinMatch = 3;
+        static constexpr auto inline MaxMatch = MinMatch + 127;
+        static constexpr auto inline MaxRun = 130;
+        static constexpr auto inline MaxLiterals = 128;
+        // Number of earlier positions tried for each LZ match
+        static constexpr auto inline MaxChainLength = 16;
+        static constexpr auto inline HashSize = 256;
+
+        static constexpr uint16_t inline NoPosition = 0xffff;
+
+        // Kept off the stack, which is only 2KB on core 0
+        std::array<uint16_t, HashSize> head;
+        std::array<uint16_t, SectorSize> previous;
+        std::array<uint8_t, SectorSize> lzOutput;
+
+        // Bytes sent after the format byte: RLE and LZ carry a payload length
+        size_t EncodedLength(const Result& result)
+        {
+            const auto hasLength = result.format == Format::RLE || result.format == Format::LZ;
+            return result.length + (hasLength ? 2 : 0);
+        }
+
+        bool IsFill(const uint8_t* sector)
+        {
+            return std::all_of(sector + 1, sector + SectorSize, [&](uint8_t b) { return b == sector[0]; });
+        }
+
+        // Returns the payload length, or SectorSize if RLE does not pay off
+        size_t EncodeRLE(const uint8_t* sector, uint8_t* output)
+        {
+            size_t in = 0, out = 0;
+            while(in < SectorSize) {
+                size_t run = 1;
+                while(in + run < SectorSize && run < MaxRun && sector[in + run] == sector[in]) ++run;
+                if (run >= MinMatch) {
+                    if (out + 2 >= SectorSize) return SectorSize;
+                    output[out++] = run + 125;
+                    output[out++] = sector[in];
+                    in += run;
+                    continue;
+                }
+
+                // Collect literals up to the next run of at least three bytes
+                size_t literals = 0;
+                while(in + literals < SectorSize && literals < MaxLiterals) {
+                    const auto p = in + literals;
+                    if (p + 2 < SectorSize && sector[p] == sector[p + 1] && sector[p] == sector[p + 2]) break;
+                    ++literals;
+                }
+                if (out + 1 + literals >= SectorSize) return SectorSize;
+                output[out++] = literals - 1;
+                memcpy(&output[out], &sector[in], literals);
+                out += literals;
+                in += literals;
+            }
+            return out;
+        }
+
+        unsigned Hash(const uint8_t* p)
+        {
+            return ((p[0] << 4) ^ (p[1] << 2) ^ p[2]) & (HashSize - 1);
+        }
+
+        // Returns the payload length, or SectorSize if LZ does not pay off
+        size_t EncodeLZ(const uint8_t* sector, uint8_t* output)
+        {
+            head.fill(NoPosition);
+
+            const auto insert = [&](size_t pos) {
+                if (pos + MinMatch > SectorSize) return;
+                const auto h = Hash(&sector[pos]);
+                previous[pos] = head[h];
+                head[h] = pos;
+            };
+
+            size_t in = 0, out = 0;
+            size_t flagOffset = 0;
+            int flagBit = 8;
+            while(in < SectorSize) {
+                if (flagBit == 8) {
+                    if (out >= SectorSize - 1) return SectorSize;
+                    flagOffset = out++;
+                    output[flagOffset] = 0;
+                    flagBit = 0;
+                }
+
+                size_t bestLength = 0, bestDistance = 0;
+                if (in + MinMatch <= SectorSize) {
+                    auto candidate = head[Hash(&sector[in])];
+                    for(int chain = 0; candidate != NoPosition && chain < MaxChainLength; ++chain, candidate = previous[candidate]) {
+                        const size_t limit = std::min<size_t>(MaxMatch, SectorSize - in);
+                        size_t length = 0;
+                        while(length < limit && sector[candidate + length] == sector[in + length]) ++length;
+                        if (length > bestLength) {
+                            bestLength = length;
+                            bestDistance = in - candidate;
+                            if (length == limit) break;
+                        }
+                    }
+                }
+
+                if (bestLength >= MinMatch) {
+                    if (out + 2 >= SectorSize) return SectorSize;
+                    const uint16_t word = ((bestDistance - 1) << 7) | (bestLength - MinMatch);
+                    output[out++] = word >> 8;
+                    output[out++] = word & 0xff;
+                    output[flagOffset] |= 1 << flagBit;
+                    for(size_t n = 0; n < bestLength; ++n) insert(in + n);
+                    in += bestLength;
+                } else {
+                    if (out + 1 >= SectorSize) return SectorSize;
+                    output[out++] = sector[in];
+                    insert(in);
+                    ++in;
+                }
+                ++flagBit;
+            }
+            return out;
+        }
+
+        bool DecodeRLE(const uint8_t* payload, size_t length, uint8_t* sector)
+        {
+            size_t in = 0, out = 0;
+            while(in < length) {
+                const auto c = payload[in++];
+                if (c < 128) {
+                    const size_t count = c + 1;
+                    if (in + count > length || out + count > SectorSize) return false;
+                    memcpy(&sector[out], &payload[in], count);
+                    in += count;
+                    out += count;
+                } else {
+                    const size_t count = c - 125;
+                    if (in >= length || out + count > SectorSize) return false;
+                    memset(&sector[out], payload[in++], count);
+                    out += count;
+                }
+            }
+            return out == SectorSize;
+        }
+
+        bool DecodeLZ(const uint8_t* payload, size_t length, uint8_t* sector)
+        {
+            size_t in = 0, out = 0;
+            while(in < length) {
+                const auto flags = payload[in++];
+                for(int bit = 0; bit < 8 && in < length; ++bit) {
+                    if ((flags & (1 << bit)) == 0) {
+                        if (out >= SectorSize) return false;
+                        sector[out++] = payload[in++];
+                        continue;
+                    }
+                    if (in + 2 > length) return false;
+                    const uint16_t word = (payload[in] << 8) | payload[in + 1];
+                    in += 2;
+                    const size_t distance = (word >> 7) + 1;
+                    const size_t count = (word & 0x7f) + MinMatch;
+                    if (distance > out || out + count > SectorSize) return false;
+                    for(size_t n = 0; n < count; ++n, ++out) {
+                        sector[out] = sector[out - distance];
+                    }
+                }
+            }
+            return out == SectorSize;
+        }
+    }
+
+    Result Compress(const uint8_t* sector, uint8_t* output)
+    {
+        if (IsFill(sector)) {
+            output[0] = sector[0];
+            return { Format::Fill, 1 };
+        }
+
+        Result best{ Format::Raw, SectorSize };
+        if (const Result rle{ Format::RLE, EncodeRLE(sector, output) }; EncodedLength(rle) < EncodedLength(best)) {
+            best = rle;
+        }
+
+        // Only keep the LZ result if it beats RLE, which is already in output
+        if (const Result lz{ Format::LZ, EncodeLZ(sector, lzOutput.data()) }; EncodedLength(lz) < EncodedLength(best)) {
+            best = lz;
+            memcpy(output, lzOutput.data(), lz.length);
+        }
+        return best;
+    }
+
+    bool Decompress(Format format, const uint8_t* payload, size_t length, uint8_t* sector)
+    {
+        switch(format) {
+            case Format::Raw:
+                if (length != SectorSize) return false;
+                memcpy(sector, payload, SectorSize);
+                return true;
+            case Format::Fill:
+                if (length != 1) return false;
+                memset(sector, payload[0], SectorSize);
+                return true;
+            case Format::RLE:
+                return DecodeRLE(payload, length, sector);
+            case Format::LZ:
+                return DecodeLZ(payload, length, sector);
+        }
+        return false;
+    }
+}
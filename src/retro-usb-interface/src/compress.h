@@ -0,0 +1,71 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Sector compression for the storage protocol. A compressed sector consists
+ * of a format byte, followed by:
+ *
+ *   Raw  (0) - the 512 sector bytes
+ *   Fill (1) - a single byte; every byte of the sector has this value
+ *   RLE  (2) - payload length[2], payload
+ *   LZ   (3) - payload length[2], payload
+ *
+ * RLE payload: a control byte c, followed by c + 1 literal bytes if c < 128,
+ * or by a single byte which is repeated c - 125 times (3..130) otherwise.
+ *
+ * LZ payload: groups of a flag byte followed by up to eight items, one per
+ * flag bit (LSB first). A clear bit is a literal byte; a set bit is a 16-bit
+ * big-endian match word, with the distance minus one in the upper 9 bits and
+ * the length minus three in the lower 7 bits. Matches may overlap.
+ */
+namespace compress
+{
+    enum class Format : uint8_t
+    {
+        Raw = 0,
+        Fill = 1,
+        RLE = 2,
+        LZ = 3,
+    };
+
+    static constexpr auto inline SectorSize = 512;
+
+    struct Result
+    {
+        Format format{};
+        // Number of payload bytes; for Raw, the payload is the sector itself
+        size_t length{};
+    };
+
+    // Picks the smallest encoding of sector; output must hold SectorSize bytes
+    Result Compress(const uint8_t* sector, uint8_t* output);
+
+    // Returns false if the payload is malformed
+    bool Decompress(Format format, const uint8_t* payload, size_t length, uint8_t* sector);
+}
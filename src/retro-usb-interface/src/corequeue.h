@@ -0,0 +1,91 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include "fifo.h"
+#include "pico/time.h"
+
+struct QueueStatistics
+{
+    uint32_t messages{};
+    uint32_t max_depth{};
+    uint32_t max_latency_us{};
+    uint64_t total_latency_us{};
+};
+
+/*
+ * Queue between the two cores: one core pushes, the other pops. Every
+ * element is stamped when it is pushed, so the consumer can keep track of
+ * how long elements wait and how deep the queue gets. The statistics belong
+ * to the consumer; the other core must not read them directly.
+ */
+template<size_t Capacity, typename Element>
+class CoreQueue
+{
+    struct Entry
+    {
+        Element element{};
+        uint32_t queued_us{};
+    };
+    Fifo<Capacity, Entry> fifo;
+    QueueStatistics stats{};
+
+public:
+    bool empty() const
+    {
+        return fifo.empty();
+    }
+
+    bool full() const
+    {
+        return fifo.full();
+    }
+
+    bool push(Element&& element)
+    {
+        return fifo.push(Entry{ std::move(element), time_us_32() });
+    }
+
+    std::optional<Element> pop()
+    {
+        if (fifo.empty()) return {};
+        const auto depth = static_cast<uint32_t>(fifo.bytes_left());
+        auto entry = fifo.pop();
+        const auto latency = time_us_32() - entry.queued_us;
+        ++stats.messages;
+        stats.max_depth = std::max(stats.max_depth, depth);
+        stats.max_latency_us = std::max(stats.max_latency_us, latency);
+        stats.total_latency_us += latency;
+        return std::move(entry.element);
+    }
+
+    const QueueStatistics& statistics() const
+    {
+        return stats;
+    }
+};
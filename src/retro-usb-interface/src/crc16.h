@@ -0,0 +1,146 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * CRC-16-CCITT as used by the storage protocol: polynomial 0x1021, initial
+ * value 0, data processed MSB first and no final XOR (also known as
+ * CRC-16/XMODEM). This is also what the RP2040 DMA sniffer calculates.
+ *
+ * CRC16_IMPLEMENTATION selects the speed/size trade-off:
+ *   0 - bitwise, no table
+ *   1 - one 256-entry table (512 bytes)
+ *   2 - slice-by-4, four 256-entry tables (2KB)
+ */
+#ifndef CRC16_IMPLEMENTATION
+#define CRC16_IMPLEMENTATION 1
+#endif
+
+namespace crc16
+{
+    static constexpr uint16_t inline Polynomial = 0x1021;
+
+    constexpr uint16_t UpdateBitwise(uint16_t crc, uint8_t byte)
+    {
+        crc = crc ^ (byte << 8);
+        for(int n = 0; n < 8; ++n) {
+            const auto carry = crc & 0x8000;
+            crc = crc << 1;
+            if (carry) {
+                crc = crc ^ Polynomial;
+            }
+        }
+        return crc;
+    }
+
+    namespace detail
+    {
+        using Table = std::array<uint16_t, 256>;
+
+        // tables[k][i] is the CRC of byte i followed by k zero bytes
+        template<size_t Slices>
+        constexpr auto GenerateTables()
+        {
+            std::array<Table, Slices> tables{};
+            for(size_t i = 0; i < 256; ++i) {
+                tables[0][i] = UpdateBitwise(0, i);
+            }
+            for(size_t k = 1; k < Slices; ++k) {
+                for(size_t i = 0; i < 256; ++i) {
+                    const uint16_t prev = tables[k - 1][i];
+                    tables[k][i] = static_cast<uint16_t>(prev << 8) ^ tables[0][prev >> 8];
+                }
+            }
+            return tables;
+        }
+
+        static constexpr auto inline Tables = GenerateTables<CRC16_IMPLEMENTATION == 2 ? 4 : 1>();
+    }
+
+    constexpr uint16_t UpdateTable(uint16_t crc, uint8_t byte)
+    {
+        return static_cast<uint16_t>(crc << 8) ^ detail::Tables[0][(crc >> 8) ^ byte];
+    }
+
+#if CRC16_IMPLEMENTATION == 2
+    constexpr uint16_t UpdateSliceBy4(uint16_t crc, const uint8_t* data, size_t length)
+    {
+        const auto& t = detail::Tables;
+        for(; length >= 4; data += 4, length -= 4) {
+            crc = t[3][data[0] ^ (crc >> 8)] ^ t[2][data[1] ^ (crc & 0xff)] ^ t[1][data[2]] ^ t[0][data[3]];
+        }
+        for(; length > 0; ++data, --length) {
+            crc = UpdateTable(crc, *data);
+        }
+        return crc;
+    }
+#endif
+
+    constexpr uint16_t Update(uint16_t crc, uint8_t byte)
+    {
+#if CRC16_IMPLEMENTATION == 0
+        return UpdateBitwise(crc, byte);
+#else
+        return UpdateTable(crc, byte);
+#endif
+    }
+
+    constexpr uint16_t Update(uint16_t crc, const uint8_t* data, size_t length)
+    {
+#if CRC16_IMPLEMENTATION == 2
+        return UpdateSliceBy4(crc, data, length);
+#else
+        for(size_t n = 0; n < length; ++n) {
+            crc = Update(crc, data[n]);
+        }
+        return crc;
+#endif
+    }
+
+    namespace detail
+    {
+        constexpr uint8_t CheckInput[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+
+        constexpr uint16_t CheckBitwise()
+        {
+            uint16_t crc = 0;
+            for(auto b: CheckInput) crc = UpdateBitwise(crc, b);
+            return crc;
+        }
+
+        // Standard CRC-16/XMODEM check value
+        static_assert(CheckBitwise() == 0x31c3);
+        static_assert(Update(0, CheckInput, sizeof(CheckInput)) == CheckBitwise());
+        static_assert(Update(0x1234, CheckInput + 1, sizeof(CheckInput) - 1) == [] {
+            uint16_t crc = 0x1234;
+            for(size_t n = 1; n < sizeof(CheckInput); ++n) crc = UpdateBitwise(crc, CheckInput[n]);
+            return crc;
+        }());
+    }
+}
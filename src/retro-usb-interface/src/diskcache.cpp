@@ -0,0 +1,216 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "diskcache.h"
+#include <array>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include "umass.h"
+#include "pico/time.h"
+
+namespace diskcache
+{
+    namespace
+    {
+        // 16 sets of 4 ways = 64 sectors, or 32KB of SRAM
+        static constexpr auto inline CacheSets = 16;
+        static constexpr auto inline CacheWays = 4;
+        static constexpr auto inline CachePolicy = EvictionPolicy::LeastRecentlyUsed;
+
+        // Maximum number of contiguous sectors written using a single write10
+        static constexpr auto inline MaxWriteRun = 8;
+        // Modified sectors are written back after this many ms without writes
+        static constexpr auto inline WriteBackDelayMs = 2'000;
+        // Number of cache misses that can be outstanding at the same time
+        static constexpr auto inline MaxPendingReads = 2;
+
+        // Cached sectors are identified by unit and sector number; all units
+        // share the same cache
+        using Key = uint64_t;
+        SectorCache<CacheSets, CacheWays, CachePolicy, 512, Key> cache;
+        std::array<uint8_t, MaxWriteRun * 512> writeRunBuffer;
+        uint32_t lastWriteMs = 0;
+
+        Key MakeKey(uint8_t unit, uint32_t sector_nr)
+        {
+            return (static_cast<Key>(unit) << 32) | sector_nr;
+        }
+
+        uint8_t UnitOf(Key key) { return static_cast<uint8_t>(key >> 32); }
+        uint32_t SectorOf(Key key) { return static_cast<uint32_t>(key); }
+
+        struct PendingRead
+        {
+            bool busy{};
+            Key key{};
+            uint8_t* buffer{};
+            Completion completion{};
+            uintptr_t context{};
+        };
+        std::array<PendingRead, MaxPendingReads> pendingReads;
+
+        struct FlushState
+        {
+            bool active{};
+            bool writing{};
+            bool failed{};
+            Key first{};
+            size_t count{};
+            Completion completion{};
+            uintptr_t context{};
+        };
+        FlushState flush;
+
+        void OnReadDone(bool success, uintptr_t context)
+        {
+            auto& read = pendingReads[context];
+            read.busy = false;
+            if (success) {
+                cache.insert(read.key, read.buffer);
+            }
+            read.completion(success, read.context);
+        }
+
+        void OnWriteDone(bool success, uintptr_t)
+        {
+            flush.writing = false;
+            if (!success) {
+                printf("diskcache: unable to write back %zu sector(s) at %" PRIu32 " of unit %d\n", flush.count, SectorOf(flush.first), UnitOf(flush.first));
+                flush.failed = true;
+                return;
+            }
+            for(size_t n = 0; n < flush.count; ++n) {
+                cache.mark_clean(flush.first + n);
+            }
+        }
+
+        void FinishFlush()
+        {
+            const auto completion = flush.completion;
+            const auto context = flush.context;
+            const auto success = !flush.failed;
+            flush = {};
+            if (completion) completion(success, context);
+        }
+
+        void RunFlush()
+        {
+            if (!flush.active || flush.writing) return;
+
+            const auto first = cache.first_dirty();
+            if (flush.failed || !first) {
+                FinishFlush();
+                return;
+            }
+
+            // A run never crosses into another unit, as sector numbers do not wrap
+            size_t count = 0;
+            while(count < MaxWriteRun) {
+                const auto data = cache.dirty_data(*first + count);
+                if (!data) break;
+                memcpy(&writeRunBuffer[count * 512], data, 512);
+                ++count;
+            }
+
+            flush.first = *first;
+            flush.count = count;
+            flush.writing = true;
+            if (!umass::SubmitWrite(UnitOf(*first), SectorOf(*first), count, writeRunBuffer.data(), OnWriteDone, 0)) {
+                flush.writing = false;
+                flush.failed = true;
+            }
+        }
+    }
+
+    void ReadSector(uint8_t unit, uint32_t sector_nr, uint8_t* buffer, Completion completion, uintptr_t context)
+    {
+        const auto key = MakeKey(unit, sector_nr);
+        if (cache.lookup(key, buffer)) {
+            completion(true, context);
+            return;
+        }
+
+        for(size_t n = 0; n < pendingReads.size(); ++n) {
+            auto& read = pendingReads[n];
+            if (read.busy) continue;
+            read = { .busy = true, .key = key, .buffer = buffer, .completion = completion, .context = context };
+            if (!umass::SubmitRead(unit, sector_nr, 1, buffer, OnReadDone, n)) {
+                read.busy = false;
+                break;
+            }
+            return;
+        }
+        completion(false, context);
+    }
+
+    bool CanWrite(uint8_t unit, uint32_t sector_nr)
+    {
+        return !flush.active && !cache.needs_writeback(MakeKey(unit, sector_nr));
+    }
+
+    void WriteSector(uint8_t unit, uint32_t sector_nr, const uint8_t* buffer)
+    {
+        lastWriteMs = to_ms_since_boot(get_absolute_time());
+        cache.write(MakeKey(unit, sector_nr), buffer);
+    }
+
+    void Flush(Completion completion, uintptr_t context)
+    {
+        flush.active = true;
+        if (completion) {
+            flush.completion = completion;
+            flush.context = context;
+        }
+    }
+
+    bool IsFlushing()
+    {
+        return flush.active;
+    }
+
+    void Run()
+    {
+        RunFlush();
+
+        const auto uptimeInMs = to_ms_since_boot(get_absolute_time());
+        if (flush.active || uptimeInMs - lastWriteMs < WriteBackDelayMs) return;
+        if (cache.dirty_count() == 0) return;
+        // On failure, try again after another delay
+        lastWriteMs = uptimeInMs;
+        Flush();
+    }
+
+    void Invalidate(uint8_t unit)
+    {
+        if (const auto dirty = cache.invalidate(MakeKey(unit, 0), MakeKey(unit, UINT32_MAX)); dirty > 0) {
+            printf("diskcache: discarding %zu modified sector(s) of unit %d\n", dirty, unit);
+        }
+    }
+
+    SectorCacheStatistics GetStatistics()
+    {
+        return cache.statistics();
+    }
+}
@@ -0,0 +1,60 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include "sectorcache.h"
+#include "umass.h"
+
+namespace diskcache
+{
+    using Completion = umass::Completion;
+
+    // Reads a sector of a umass unit, going to the USB device only on a cache
+    // miss. On a hit, completion is called before ReadSector() returns
+    void ReadSector(uint8_t unit, uint32_t sector_nr, uint8_t* buffer, Completion completion, uintptr_t context);
+
+    // False if other sectors must be written back before sector_nr can be
+    // stored, or a write-back is in progress; try again once it has finished
+    bool CanWrite(uint8_t unit, uint32_t sector_nr);
+
+    // Stores a sector in the cache; it reaches the device on the next flush.
+    // Must only be called if CanWrite() returned true
+    void WriteSector(uint8_t unit, uint32_t sector_nr, const uint8_t* buffer);
+
+    // Starts writing all modified sectors of all units, in runs of
+    // contiguous sectors; completion (if any) is called once all are written
+    void Flush(Completion completion = nullptr, uintptr_t context = 0);
+
+    bool IsFlushing();
+
+    // Progresses flushes, and starts one once writes have been idle for a while
+    void Run();
+
+    // Drops all cached sectors of a unit, i.e. because the medium has changed
+    void Invalidate(uint8_t unit);
+
+    SectorCacheStatistics GetStatistics();
+}
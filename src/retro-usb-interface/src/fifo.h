@@ -24,64 +24,136 @@
  */
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <span>
 
+/*
+ * Single-producer/single-consumer FIFO. One side (i.e. an interrupt handler)
+ * may push while the other side (i.e. the main loop) pops, without either of
+ * them disabling interrupts:
+ *
+ * - readIndex is only written by the consumer, writeIndex only by the
+ *   producer. Both run freely and are masked when indexing, so all Capacity
+ *   elements can be used;
+ * - an element is stored before writeIndex is released, and read before
+ *   readIndex is released, so neither side sees a half-written element.
+ *
+ * Only atomic loads and stores are used; the Cortex-M0+ has no atomic
+ * read-modify-write instructions.
+ *
+ * push() is for the producer; peek(), front(), drop() and pop() are for the
+ * consumer. clear() must only be used while the other side is inactive.
+ */
 template<size_t Capacity, typename Element = uint8_t>
 class Fifo
 {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+    static constexpr size_t Mask = Capacity - 1;
+
     std::array<Element, Capacity> buffer{};
-    size_t readOffset = 0;
-    size_t writeOffset = 0;
+    std::atomic<size_t> readIndex{};
+    std::atomic<size_t> writeIndex{};
+
+    // Copies count elements starting at index, which may wrap
+    template<typename Out>
+    void copy_out(size_t index, size_t count, Out out) const
+    {
+        const auto first = std::min(count, Capacity - (index & Mask));
+        std::copy_n(&buffer[index & Mask], first, out);
+        std::copy_n(&buffer[0], count - first, out + first);
+    }
 
 public:
     bool empty() const
     {
-        return readOffset == writeOffset;
+        return bytes_left() == 0;
     }
 
     void clear()
     {
-        readOffset = writeOffset;
+        readIndex.store(writeIndex.load(std::memory_order_relaxed), std::memory_order_relaxed);
     }
 
     bool full() const
     {
-        return bytes_left() <= 1;
+        return bytes_left() == Capacity;
     }
 
+    // Number of elements stored
     size_t bytes_left() const
     {
-        if (readOffset == writeOffset) {
-            return 0;
-        } else if (readOffset < writeOffset) {
-            return writeOffset - readOffset;
-        } else {
-            return (buffer.size() - readOffset) + writeOffset;
-        }
+        return writeIndex.load(std::memory_order_acquire) - readIndex.load(std::memory_order_acquire);
+    }
+
+    size_t space_left() const
+    {
+        return Capacity - bytes_left();
     }
 
     auto peek(size_t offset = 0) const
     {
-        return buffer[(readOffset + offset) % buffer.size()];
+        return buffer[(readIndex.load(std::memory_order_relaxed) + offset) & Mask];
+    }
+
+    // Copies up to values.size() elements, starting at offset, without
+    // removing them; returns the number copied
+    size_t peek(std::span<Element> values, size_t offset = 0) const
+    {
+        const auto available = bytes_left();
+        if (offset >= available) return 0;
+        const auto count = std::min(values.size(), available - offset);
+        copy_out(readIndex.load(std::memory_order_relaxed) + offset, count, values.begin());
+        return count;
+    }
+
+    Element& front()
+    {
+        return buffer[readIndex.load(std::memory_order_relaxed) & Mask];
     }
 
     void drop(size_t amount)
     {
-        readOffset = (readOffset + amount) % buffer.size();
+        readIndex.store(readIndex.load(std::memory_order_relaxed) + amount, std::memory_order_release);
     }
 
     auto pop()
     {
-        auto value = std::move(buffer[readOffset]);
+        auto value = std::move(front());
         drop(1);
         return value;
     }
 
-    void push(Element&& value)
+    // Removes up to values.size() elements; returns the number removed
+    size_t pop(std::span<Element> values)
+    {
+        const auto count = peek(values);
+        drop(count);
+        return count;
+    }
+
+    // False if the FIFO is full, in which case value is not stored
+    bool push(Element&& value)
+    {
+        const auto write = writeIndex.load(std::memory_order_relaxed);
+        if (write - readIndex.load(std::memory_order_acquire) == Capacity) return false;
+        buffer[write & Mask] = std::move(value);
+        writeIndex.store(write + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Stores as many of values as fit; returns the number stored
+    size_t push(std::span<const Element> values)
     {
-        buffer[writeOffset] = std::move(value);
-        writeOffset = (writeOffset + 1) % buffer.size();
+        const auto write = writeIndex.load(std::memory_order_relaxed);
+        const auto count = std::min(values.size(), Capacity - (write - readIndex.load(std::memory_order_acquire)));
+        const auto first = std::min(count, Capacity - (write & Mask));
+        std::copy_n(values.begin(), first, &buffer[write & Mask]);
+        std::copy_n(values.begin() + first, count - first, &buffer[0]);
+        writeIndex.store(write + count, std::memory_order_release);
+        return count;
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,100 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+
+/*
+ * Histogram of durations in microseconds, cheap enough to update on every
+ * event. Below 8 us every value has its own bucket; above that, every power
+ * of two is split in four buckets, so percentiles are accurate to 25%.
+ * Values of 2^23 us (about 8.4 seconds) and up all end up in the last
+ * bucket.
+ */
+class LatencyHistogram
+{
+    static constexpr auto inline LinearBuckets = 8;
+    static constexpr auto inline MaxExponent = 23;
+    // The last bucket starts at 2^MaxExponent
+    std::array<uint32_t, (MaxExponent - 1) * 4 + 1> buckets{};
+    uint32_t count_{};
+    uint32_t min_{UINT32_MAX};
+    uint32_t max_{};
+    uint64_t total_{};
+
+    static constexpr size_t BucketOf(uint32_t us)
+    {
+        if (us < LinearBuckets) return us;
+        const auto exponent = std::bit_width(us) - 1;
+        if (exponent >= MaxExponent) return (MaxExponent - 1) * 4;
+        return (exponent - 1) * 4 + ((us >> (exponent - 2)) & 3);
+    }
+
+    // Lowest value that ends up in the bucket
+    static constexpr uint32_t LowerBound(size_t bucket)
+    {
+        if (bucket < LinearBuckets) return bucket;
+        const auto exponent = bucket / 4 + 1;
+        return (4 + bucket % 4) << (exponent - 2);
+    }
+
+public:
+    void Add(uint32_t us)
+    {
+        ++buckets[BucketOf(us)];
+        ++count_;
+        min_ = std::min(min_, us);
+        max_ = std::max(max_, us);
+        total_ += us;
+    }
+
+    void Reset()
+    {
+        *this = {};
+    }
+
+    uint32_t count() const { return count_; }
+    uint32_t min() const { return count_ > 0 ? min_ : 0; }
+    uint32_t max() const { return max_; }
+    uint32_t mean() const { return count_ > 0 ? static_cast<uint32_t>(total_ / count_) : 0; }
+
+    // Upper bound of the bucket holding the given percentile, i.e. 990 for p99
+    uint32_t percentile(uint32_t perMille) const
+    {
+        const auto wanted = (static_cast<uint64_t>(count_) * perMille + 999) / 1000;
+        uint64_t seen = 0;
+        for(size_t bucket = 0; bucket < buckets.size(); ++bucket) {
+            seen += buckets[bucket];
+            if (seen >= wanted && seen > 0) {
+                if (bucket + 1 == buckets.size()) return max_;
+                return std::min(LowerBound(bucket + 1) - 1, max_);
+            }
+        }
+        return max_;
+    }
+};
@@ -24,13 +24,16 @@
  */
 #include <stdlib.h>
 #include <stdio.h>
-#include <deque>
 #include "pico/stdlib.h"
-#include "pico/time.h"
-#include "bsp/board.h"
+#include "hardware/pio.h"
 #include "keyboard.h"
+#include "ps2device.pio.h"
 
 // https://www.burtonsys.com/ps2_chapweske.htm
+//
+// The PS/2 protocol itself runs in a PIO state machine (see ps2device.pio);
+// Run() only moves bytes in and out of its FIFOs, so it never waits for the
+// bus or disables interrupts.
 
 namespace keyboard
 {
@@ -40,165 +43,104 @@ namespace keyboard
         static constexpr auto inline KeyboardDataN = 11;
         static constexpr auto inline KeyboardClockReadN = 12;
         static constexpr auto inline KeyboardDataReadN = 13;
-
-        static constexpr auto inline DebugOut1 = 15;
-        static constexpr auto inline DebugOut2 = 16;
-        static constexpr auto inline DebugOut3 = 17;
     }
 
     namespace
     {
-        void ClockPulse()
-        {
-            gpio_put(pin::KeyboardClockN, 0);
-            busy_wait_us(400);
-            gpio_put(pin::KeyboardClockN, 1);
-            busy_wait_us(400);
-        }
+        // Status words pushed by the state machine after each attempt to
+        // send; host frames never match these as their lower bits are clear
+        static constexpr uint32_t StatusSent = 1;
+        static constexpr uint32_t StatusInhibited = 2;
+        static constexpr auto inline HostFrameShift = 21;
 
-        int SendByte(uint8_t scancode)
-        {
-            gpio_put(pin::DebugOut3, 1);
-            busy_wait_us(100);
-
-            // Calculate parity
-            int parity = 1;
-            for(int n = 0; n < 8; ++n) {
-                if (scancode & (1 << n))
-                    parity ^= 1;
-            }
+        static constexpr uint8_t Ack = 0xfa;
+        static constexpr uint8_t Resend = 0xfe;
+        static constexpr uint8_t SelfTestPassed = 0xaa;
 
-            // Wait until the clock is high
-            while(gpio_get(pin::KeyboardClockReadN) == 0);
+        PIO pio = pio0;
+        uint sm;
 
-            // Generate the data packt
-            //uint16_t v = 0b11'00011110'0;
-            uint16_t v = 0b10'00000000'0;
-            /*             ^^ \------/ ^*/
-            /*        stop-/|   data   |*/
-            /*            parity     start*/
-            v |= (static_cast<uint16_t>(scancode) << 1);
-            v |= (parity << 9);
-            for(int n = 0; n < 11; ++n) {
-                if (gpio_get(pin::KeyboardClockReadN) == 0) {
-                    printf("SendByte: host messing with the clock, aborting\n");
-                    // Release bus
-                    gpio_put(pin::KeyboardDataN, 1);
-                    gpio_put(pin::KeyboardClockN, 1);
-                    // Pulse debug2 to make this visible
-                    gpio_put(pin::DebugOut2, 1);
-                    busy_wait_us(10);
-                    gpio_put(pin::DebugOut2, 0);
-                    return 0;
-                }
-                gpio_put(pin::KeyboardDataN, v & 1);
-                ClockPulse();
-                v >>= 1;
+        bool OddParity(uint32_t value)
+        {
+            int parity = 1;
+            for(; value != 0; value >>= 1) {
+                parity ^= value & 1;
             }
+            return parity;
+        }
 
-            // Release data/clock
-            gpio_put(pin::KeyboardDataN, 1);
-            gpio_put(pin::KeyboardClockN, 1);
-            busy_wait_us(400);
-            gpio_put(pin::DebugOut3, 0);
-            return 1;
+        // Start bit, data, parity and stop bit, in the order they are sent
+        uint32_t Frame(uint8_t data)
+        {
+            return (static_cast<uint32_t>(data) << 1) | (OddParity(data) << 9) | (1 << 10);
         }
     }
 
     Keyboard::Keyboard()
     {
-        gpio_init(pin::KeyboardClockN);
-        gpio_init(pin::KeyboardDataN);
         gpio_init(pin::KeyboardClockReadN);
         gpio_init(pin::KeyboardDataReadN);
-        gpio_init(pin::DebugOut1);
-        gpio_init(pin::DebugOut2);
-        gpio_init(pin::DebugOut3);
-        gpio_set_dir(pin::KeyboardClockN, GPIO_OUT);
-        gpio_set_dir(pin::KeyboardDataN, GPIO_OUT);
-        gpio_set_dir(pin::DebugOut1, GPIO_OUT);
-        gpio_set_dir(pin::DebugOut2, GPIO_OUT);
-        gpio_set_dir(pin::DebugOut3, GPIO_OUT);
         gpio_set_dir(pin::KeyboardClockReadN, GPIO_IN);
         gpio_set_dir(pin::KeyboardDataReadN, GPIO_IN);
-        gpio_put(pin::DebugOut1, 0);
-        gpio_put(pin::DebugOut2, 0);
-        gpio_put(pin::DebugOut3, 0);
 
-        // Place both GPIO's high to signal idle bus
-        gpio_put(pin::KeyboardClockN, 1);
-        gpio_put(pin::KeyboardDataN, 1);
+        sm = pio_claim_unused_sm(pio, true);
+        const auto offset = pio_add_program(pio, &ps2_device_program);
+        ps2_device_program_init(pio, sm, offset, pin::KeyboardClockN, pin::KeyboardDataN, pin::KeyboardClockReadN, pin::KeyboardDataReadN);
     }
 
-    void Keyboard::Run()
+    void Keyboard::OnHostFrame(uint32_t frame)
     {
-        uint32_t intr = save_and_disable_interrupts();
-        if (gpio_get(pin::KeyboardClockReadN) == 0 && gpio_get(pin::KeyboardDataReadN) == 0)
-        {
-            // Clock is LO here (driven by the host), we do not drive data...
-            printf("Detected host RTS\n");
-            gpio_put(pin::DebugOut1, 1);
-
-            // Wait until host releases clock
-            while(gpio_get(pin::KeyboardClockReadN) == 0);
-
-            // Clock in the data
-            uint16_t result = 0;
-            int num_ones = 0;
-            for(unsigned int n = 0; n < 10; ++n) {
-                if (gpio_get(pin::KeyboardDataReadN)) {
-                    result |= (1 << n);
-                    ++num_ones;
-                }
-                ClockPulse();
+        // Start bit in bit 0, then the data, the parity bit and the stop
+        // bit. The stop bit is 0 if the host did not release data in time
+        const uint8_t data = (frame >> 1) & 0xff;
+        const auto parity = (frame >> 9) & 1;
+        const auto stop = (frame >> 10) & 1;
+        if ((frame & 1) != 0 || parity != OddParity(data) || stop != 1) {
+            printf("keyboard: bad frame %x from host\n", frame);
+            // A host holding data low is seen as sending frame after frame;
+            // one request to resend is enough
+            if (bytesToSend.empty() || bytesToSend.peek(bytesToSend.bytes_left() - 1) != Resend) {
+                bytesToSend.push(uint8_t{Resend});
             }
-            result >>= 1; // throw away first bit, it's always zero
-            printf("result %x num_ones %d -> data byte %x\n", result, num_ones, result & 0xff);
-
-            // Wait until DATA is released (it goes back hi)
-            while(gpio_get(pin::KeyboardDataReadN) == 0);
-
-            gpio_put(pin::DebugOut2, 1);
-
-            // Acknowledge by bringing data low
-            gpio_put(pin::KeyboardDataN, 0);
-            // Generate clock
-            ClockPulse();
-
-            gpio_put(pin::KeyboardDataN, 1);
-
-            gpio_put(pin::DebugOut2, 0);
-            gpio_put(pin::DebugOut1, 0);
+            return;
+        }
 
-            result &= 0xff;
-            if (result == 0xff) {
-                printf("RESET command\n");
-                bytesToSend.push_back(0xfa);
-                bytesToSend.push_back(0xaa);
-            } else {
-                printf("unknown command %x\n");
-                bytesToSend.push_back(0xfa);
-            }
+        bool queued;
+        if (data == 0xff) {
+            printf("keyboard: reset\n");
+            queued = bytesToSend.push(uint8_t{Ack}) && bytesToSend.push(uint8_t{SelfTestPassed});
+        } else {
+            printf("keyboard: unknown command %x\n", data);
+            queued = bytesToSend.push(uint8_t{Ack});
+        }
+        if (!queued) {
+            printf("keyboard: output queue full\n");
         }
+    }
 
-        if (!bytesToSend.empty())
-        {
-            uint8_t byte = bytesToSend.front();
-            printf("sending byte %x\n", byte);
-            if (SendByte(byte)) {
-                bytesToSend.pop_front();
+    void Keyboard::Run()
+    {
+        while (!pio_sm_is_rx_fifo_empty(pio, sm)) {
+            const auto word = pio_sm_get(pio, sm);
+            switch(word) {
+                case StatusSent:
+                    bytesToSend.drop(1);
+                    sending = false;
+                    break;
+                case StatusInhibited:
+                    // The host took the bus; the byte is sent again once it
+                    // is released
+                    sending = false;
+                    break;
+                default:
+                    OnHostFrame(word >> HostFrameShift);
+                    break;
             }
         }
 
-#if 0
-        printf("KEY!\n");
-        // Scancode set 2
-        constexpr auto codes = std::to_array<uint8_t>({ 0x33, 0x24, 0x4b, 0x4b, 0x44, 0x5a });
-        for(auto c: codes) {
-            SendByte(c);
-            SendByte(0x80 | c);
+        if (!sending && !bytesToSend.empty()) {
+            pio_sm_put(pio, sm, Frame(bytesToSend.peek()));
+            sending = true;
         }
-#endif
-        restore_interrupts(intr);
     }
-}
\ No newline at end of file
+}
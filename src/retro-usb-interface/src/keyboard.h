@@ -24,7 +24,8 @@
  */
 #pragma once
 
-#include <deque>
+#include <cstdint>
+#include "fifo.h"
 
 namespace keyboard
 {
@@ -35,6 +36,10 @@ namespace keyboard
         void Run();
 
     private:
-        std::deque<uint8_t> bytesToSend;
+        void OnHostFrame(uint32_t frame);
+
+        // The front byte stays queued until the PIO reports it as sent
+        Fifo<16> bytesToSend;
+        bool sending{};
     };
 }
@@ -27,15 +27,22 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
+#include <algorithm>
 #include <array>
 #include <deque>
 
 #include "pico/stdlib.h"
 #include "pico/time.h"
+#include "pico/multicore.h"
 #include "bsp/board.h" // for board_init()
 #include "serial.h"
 #include "mouse.h"
+#include "mouseprotocol.h"
 #include "keyboard.h"
+#include "umass.h"
+#include "diskcache.h"
+#include "trace.h"
 #include "tusb.h"
 
 namespace pin {
@@ -61,6 +68,102 @@ namespace
         }
     };
 
+    struct DebugConsoleTask
+    {
+        // Values at the previous 'u', to calculate rates
+        serial::UartStatistics previousUart{};
+        uint32_t previousUartMs = 0;
+
+        void Run()
+        {
+            const auto ch = getchar_timeout_us(0);
+            if (ch == PICO_ERROR_TIMEOUT) return;
+
+            switch(ch) {
+                case 's': {
+                    for(uint8_t unit = 0; unit < umass::MaxUnits; ++unit) {
+                        if (!umass::IsReady(unit)) continue;
+                        const auto readAhead = umass::GetReadAheadStatistics(unit);
+                        printf("umass unit %d read-ahead: %" PRIu32 " hits, %" PRIu32 " misses, %" PRIu32 " prefetched, %" PRIu32 " discarded\n",
+                            unit, readAhead.hits, readAhead.misses, readAhead.prefetched, readAhead.discarded);
+                    }
+                    const auto cache = diskcache::GetStatistics();
+                    printf("sector cache: %" PRIu32 " hits, %" PRIu32 " misses, %" PRIu32 " evictions\n",
+                        cache.hits, cache.misses, cache.evictions);
+                    printf("sector cache: %" PRIu32 " writes, %" PRIu32 " merged, %" PRIu32 " written back\n",
+                        cache.writes, cache.merged_writes, cache.written_back);
+                    break;
+                }
+                case 'u': {
+                    const auto nowMs = to_ms_since_boot(get_absolute_time());
+                    const auto uart = serial::GetUartStatistics();
+                    const auto elapsedMs = std::max<uint32_t>(nowMs - previousUartMs, 1);
+                    const auto perSecond = [&](uint32_t now, uint32_t previous) {
+                        return static_cast<uint32_t>((static_cast<uint64_t>(now - previous) * 1'000) / elapsedMs);
+                    };
+                    printf("uart: %" PRIu32 " interrupts/s, %" PRIu32 " bytes/s received, %" PRIu32 " bytes/s transmitted (over %" PRIu32 " ms)\n",
+                        perSecond(uart.interrupts, previousUart.interrupts),
+                        perSecond(uart.received, previousUart.received),
+                        perSecond(uart.transmitted, previousUart.transmitted), elapsedMs);
+                    if (uart.dropped != previousUart.dropped) {
+                        printf("uart: %" PRIu32 " received bytes dropped\n", uart.dropped - previousUart.dropped);
+                    }
+                    previousUart = uart;
+                    previousUartMs = nowMs;
+                    break;
+                }
+                case 'q': {
+                    const auto print = [](const char* name, const QueueStatistics& stats) {
+                        const auto mean = stats.messages > 0 ? stats.total_latency_us / stats.messages : 0;
+                        printf("%s: %" PRIu32 " messages, max depth %" PRIu32 ", latency mean %" PRIu32 " us, max %" PRIu32 " us\n",
+                            name, stats.messages, stats.max_depth, static_cast<uint32_t>(mean), stats.max_latency_us);
+                    };
+                    print("core1 -> core0 mouse events", mouse::GetQueueStatistics());
+                    print("core1 -> core0 umass completions", umass::GetCompletionStatistics());
+                    for(uint8_t unit = 0; unit < umass::MaxUnits; ++unit) {
+                        const auto stats = umass::GetSubmissionStatistics(unit);
+                        if (stats.messages == 0) continue;
+                        printf("unit %d ", unit);
+                        print("core0 -> core1 umass requests", stats);
+                    }
+                    break;
+                }
+                case 'l': {
+                    const auto print = [](const char* name, const LatencyHistogram& histogram) {
+                        printf("mouse latency %s: %" PRIu32 " events, min %" PRIu32 " us, mean %" PRIu32 " us, p99 %" PRIu32 " us, max %" PRIu32 " us\n",
+                            name, histogram.count(), histogram.min(), histogram.mean(), histogram.percentile(990), histogram.max());
+                    };
+                    const auto& latency = mouse::GetLatency();
+                    print("report -> coalesce", latency.reportToCoalesce);
+                    print("coalesce -> enqueue", latency.coalesceToEnqueue);
+                    print("enqueue -> sent", latency.enqueueToSent);
+                    print("total", latency.total);
+                    break;
+                }
+                case 'L':
+                    mouse::ResetLatency();
+                    printf("mouse latency: reset\n");
+                    break;
+                case 'm': {
+                    const auto protocol = static_cast<mouseprotocol::Protocol>((static_cast<int>(serial::GetSelectedMouseProtocol()) + 1) % mouseprotocol::ProtocolCount);
+                    serial::SelectMouseProtocol(protocol);
+                    printf("mouse protocol: %s, from the next mouse handshake\n", mouseprotocol::ProtocolNames[static_cast<int>(protocol)]);
+                    break;
+                }
+                case 't': {
+                    static constexpr std::array<const char*, 3> names{ "off", "text", "hex (for tools/tracedecode)" };
+                    const auto output = static_cast<trace::Output>((static_cast<int>(trace::GetOutput()) + 1) % names.size());
+                    trace::SetOutput(output);
+                    printf("trace output: %s\n", names[static_cast<int>(output)]);
+                    break;
+                }
+                default:
+                    printf("debug console: s = statistics, u = uart rates since previous u, q = cross-core queues, l/L = show/reset mouse latency, m = cycle mouse protocol, t = cycle trace output\n");
+                    break;
+            }
+        }
+    };
+
     struct KeyboardTask
     {
         keyboard::Keyboard keyboard;
@@ -74,6 +177,19 @@ namespace
             keyboard.Run();
         }
     };
+
+    // Runs on core1: the USB host stack, including the HID and MSC callbacks,
+    // so that USB activity does not delay the serial side on core0
+    void UsbHostMain()
+    {
+        tuh_init(BOARD_TUH_RHPORT);
+
+        while (1) {
+            tuh_task();
+            umass::Run();
+            mouse::Run();
+        }
+    }
 }
 
 int main()
@@ -82,23 +198,27 @@ int main()
 
     printf("Retro USB interface: initializing\n");
 
-    tuh_init(BOARD_TUH_RHPORT);
-
     gpio_init(pin::LED1);
     gpio_set_dir(pin::LED1, GPIO_OUT);
 
     LedBlinkTask blinkTask;
+    DebugConsoleTask debugConsoleTask;
     serial::SerialMouse serialMouse;
-    // KeyboardTask keyboardTask;
+    KeyboardTask keyboardTask;
+
+    multicore_launch_core1(UsbHostMain);
 
     printf("Retro USB interface: ready\n");
     while (1) {
-        tuh_task();
+        umass::RunCompletions();
+        diskcache::Run();
         blinkTask.Run();
+        debugConsoleTask.Run();
+        trace::Run();
         serialMouse.Run();
-        // keyboardTask.Run();
+        keyboardTask.Run();
 
-        if (auto event = mouse::RetrieveAndResetPendingEvent(); event) {
+        while (auto event = mouse::RetrieveEvent()) {
             serialMouse.SendEvent(*event);
         }
     }
@@ -25,29 +25,88 @@
 
 #include "mouse.h"
 #include <cstdint>
-#include <utility>
+#include "corequeue.h"
+#include "fifo.h"
+#include "trace.h"
+#include "pico/time.h"
 
 namespace mouse
 {
     namespace
     {
-        std::optional<MouseEvent> pendingEvent;
+        // Reports arrive on core1 (USB host), and are sent from core0 (serial)
+        CoreQueue<16, MouseEvent> events;
+        // Events that did not fit in the queue yet; only used on core1. New
+        // reports are merged into overflowEvent until the buttons change, at
+        // which point it moves to overflowEvents, so no click is lost
+        Fifo<8, MouseEvent> overflowEvents;
+        std::optional<MouseEvent> overflowEvent;
+        // Only used by core0
+        MouseLatency latency;
+
+        void Merge(std::optional<MouseEvent>& into, const MouseEvent& event)
+        {
+            if (!into) {
+                into = event;
+                return;
+            }
+
+            into->delta_x += event.delta_x;
+            into->delta_y += event.delta_y;
+            into->wheel += event.wheel;
+            // Only reached with the same buttons, unless too many changes are waiting
+            into->button = event.button;
+            // The timestamps of the oldest event are kept, as that one waited longest
+        }
     }
 
     void OnNewEvent(const MouseEvent& event)
     {
-        if (!pendingEvent) {
-            pendingEvent = event;
-            return;
+        trace::Trace<trace::Event::MouseEvent>(static_cast<uint8_t>(event.delta_y) << 8 | static_cast<uint8_t>(event.delta_x), event.button);
+        auto stamped = event;
+        stamped.coalesced_us = time_us_32();
+        if (overflowEvent && overflowEvent->button != event.button && overflowEvents.push(MouseEvent{*overflowEvent})) {
+            overflowEvent.reset();
+        }
+        Merge(overflowEvent, stamped);
+        Run();
+    }
+
+    void Run()
+    {
+        while(!overflowEvents.empty() && events.push(MouseEvent{overflowEvents.front()})) {
+            overflowEvents.drop(1);
+        }
+        if (overflowEvents.empty() && overflowEvent && events.push(MouseEvent{*overflowEvent})) {
+            overflowEvent.reset();
         }
+    }
 
-        pendingEvent->delta_x += event.delta_x;
-        pendingEvent->delta_y += event.delta_y;
-        pendingEvent->button = event.button;
+    std::optional<MouseEvent> RetrieveEvent()
+    {
+        return events.pop();
+    }
+
+    QueueStatistics GetQueueStatistics()
+    {
+        return events.statistics();
+    }
+
+    void RecordLatency(const MouseEvent& event, uint32_t enqueued_us, uint32_t sent_us)
+    {
+        latency.reportToCoalesce.Add(event.coalesced_us - event.report_us);
+        latency.coalesceToEnqueue.Add(enqueued_us - event.coalesced_us);
+        latency.enqueueToSent.Add(sent_us - enqueued_us);
+        latency.total.Add(sent_us - event.report_us);
+    }
+
+    const MouseLatency& GetLatency()
+    {
+        return latency;
     }
 
-    std::optional<MouseEvent> RetrieveAndResetPendingEvent()
+    void ResetLatency()
     {
-        return std::exchange(pendingEvent, {});
+        latency = {};
     }
-}
\ No newline at end of file
+}
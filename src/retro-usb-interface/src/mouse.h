@@ -24,8 +24,12 @@
  */
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
+#include <cstdlib>
 #include <optional>
+#include "corequeue.h"
+#include "histogram.h"
 
 namespace mouse
 {
@@ -35,12 +39,102 @@ namespace mouse
 
     struct MouseEvent
     {
-        int8_t delta_x{};
-        int8_t delta_y{};
+        // Wide enough to merge the reports of any realistic flick
+        int32_t delta_x{};
+        int32_t delta_y{};
+        // Positive is away from the user
+        int32_t wheel{};
         uint8_t button{};
+        // Arrival of the oldest USB report merged into this event, and when
+        // it was passed to OnNewEvent()
+        uint32_t report_us{};
+        uint32_t coalesced_us{};
     };
 
+    // Latency of mouse events, from USB report to the last byte on the serial line
+    struct MouseLatency
+    {
+        LatencyHistogram reportToCoalesce;
+        LatencyHistogram coalesceToEnqueue;
+        LatencyHistogram enqueueToSent;
+        LatencyHistogram total;
+    };
+
+    /*
+     * Motion that still has to be reported to the host. USB counts are scaled
+     * down by the divisor, with the remainder kept for the next packet, so slow
+     * motion is not lost and the pointer does not drift. Motion too large for
+     * one packet is split over several, all pointing the same way. Defined
+     * here, so the host tests can use it without the rest of the mouse code.
+     */
+    class MotionAccumulator
+    {
+    public:
+        struct Step
+        {
+            int32_t x{};
+            int32_t y{};
+        };
+
+        explicit MotionAccumulator(int32_t divisor) : divisor(divisor) { }
+
+        void Add(int32_t delta_x, int32_t delta_y)
+        {
+            x += delta_x;
+            y += delta_y;
+        }
+
+        // Next packet's motion, at most limit in either direction on both axes
+        Step Next(int32_t limit) const
+        {
+            // Division truncates towards zero, leaving the remainder in the accumulator
+            const Step total{ x / divisor, y / divisor };
+            const auto largest = std::max(std::abs(total.x), std::abs(total.y));
+            if (largest <= limit) return total;
+
+            // Equal parts keep the direction of every packet close to the overall one
+            const auto packets = (largest + limit - 1) / limit;
+            return { total.x / packets, total.y / packets };
+        }
+
+        // Removes a step once its packet has been queued
+        void Consume(const Step& step)
+        {
+            x -= step.x * divisor;
+            y -= step.y * divisor;
+        }
+
+        // Whether there is enough motion left to move the pointer
+        bool pending() const
+        {
+            return std::abs(x) >= divisor || std::abs(y) >= divisor;
+        }
+
+        void Reset()
+        {
+            x = 0;
+            y = 0;
+        }
+
+    private:
+        int32_t divisor;
+        int32_t x{};
+        int32_t y{};
+    };
+
+    // Called by the USB host on core1
     void OnNewEvent(const MouseEvent&);
+    // Retries passing on events when core0 is lagging behind; call on core1
+    void Run();
+
+    // Next event, in the order they were reported; call on core0. Events are
+    // only merged while core0 lags behind, and never across a button change
+    std::optional<MouseEvent> RetrieveEvent();
+
+    QueueStatistics GetQueueStatistics();
 
-    std::optional<MouseEvent> RetrieveAndResetPendingEvent();
+    // Called on core0 once the packet for an event has been sent
+    void RecordLatency(const MouseEvent& event, uint32_t enqueued_us, uint32_t sent_us);
+    const MouseLatency& GetLatency();
+    void ResetLatency();
 }
\ No newline at end of file
@@ -0,0 +1,175 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "mouse.h"
+
+/*
+ * Serial mouse protocols. Every encoder describes the line format, what the
+ * mouse identifies itself with after a DTR handshake and how a packet is
+ * built. The serial code instantiates its send path for each of them, so the
+ * encoding is inlined there.
+ */
+namespace mouseprotocol
+{
+    enum class Protocol : uint8_t
+    {
+        Microsoft,
+        Logitech,
+        IntelliMouse,
+        MouseSystems,
+    };
+    static constexpr auto inline ProtocolCount = 4;
+    static constexpr auto inline ProtocolNames = std::to_array<const char*>({ "Microsoft", "Logitech", "IntelliMouse", "Mouse Systems" });
+
+    // Contents of a packet, in packet units
+    struct Packet
+    {
+        // Positive is right and down
+        int32_t x{};
+        int32_t y{};
+        // Positive is away from the user, as in USB reports
+        int32_t wheel{};
+        uint8_t buttons{};
+        // Buttons of the previous packet
+        uint8_t previousButtons{};
+    };
+
+    using Bytes = std::array<uint8_t, 5>;
+
+    /*
+     * Microsoft: two buttons, 7 data bits
+     *
+     * byte  d6   d5   d4   d3   d2   d1   d0
+     *    1   1   lb   rb  dy7  dy6  dx7  dx6
+     *    2   0  dx5  dx4  dx3  dx2  dx1  dx0
+     *    3   0  dy5  dy4  dy3  dy2  dy1  dy0
+     */
+    struct Microsoft
+    {
+        static constexpr auto inline Identification = std::to_array<uint8_t>({ 'M' });
+        static constexpr auto inline DataBits = 7;
+        static constexpr auto inline MaxStep = 127;
+        static constexpr auto inline MaxWheel = 0;
+
+        static size_t Encode(const Packet& packet, Bytes& bytes)
+        {
+            uint8_t byte0 = 0b100'0000;
+            if (packet.buttons & mouse::ButtonLeft) byte0 |= 0b010'0000;
+            if (packet.buttons & mouse::ButtonRight) byte0 |= 0b001'0000;
+            byte0 |= ((packet.y >> 6) & 0b11) << 2;
+            byte0 |= ((packet.x >> 6) & 0b11) << 0;
+            bytes[0] = byte0;
+            bytes[1] = packet.x & 0b0011'1111;
+            bytes[2] = packet.y & 0b0011'1111;
+            return 3;
+        }
+    };
+
+    /*
+     * Logitech (MouseMan): the Microsoft packet, followed by
+     *
+     *    4   0   mb    0    0    0    0    0
+     *
+     * while the middle button is down and once more when it is released.
+     */
+    struct Logitech
+    {
+        static constexpr auto inline Identification = std::to_array<uint8_t>({ 'M', '3' });
+        static constexpr auto inline DataBits = 7;
+        static constexpr auto inline MaxStep = Microsoft::MaxStep;
+        static constexpr auto inline MaxWheel = 0;
+
+        static size_t Encode(const Packet& packet, Bytes& bytes)
+        {
+            const auto length = Microsoft::Encode(packet, bytes);
+            if (!((packet.buttons | packet.previousButtons) & mouse::ButtonMiddle)) return length;
+            bytes[length] = (packet.buttons & mouse::ButtonMiddle) ? 0b010'0000 : 0;
+            return length + 1;
+        }
+    };
+
+    /*
+     * Microsoft IntelliMouse: the Microsoft packet, always followed by
+     *
+     *    4   0    0   mb   dz3  dz2  dz1  dz0
+     *
+     * where dz is positive when the wheel turns towards the user.
+     */
+    struct IntelliMouse
+    {
+        static constexpr auto inline Identification = std::to_array<uint8_t>({ 'M', 'Z', '@' });
+        static constexpr auto inline DataBits = 7;
+        static constexpr auto inline MaxStep = Microsoft::MaxStep;
+        static constexpr auto inline MaxWheel = 7;
+
+        static size_t Encode(const Packet& packet, Bytes& bytes)
+        {
+            const auto length = Microsoft::Encode(packet, bytes);
+            uint8_t byte3 = -packet.wheel & 0b1111;
+            if (packet.buttons & mouse::ButtonMiddle) byte3 |= 0b001'0000;
+            bytes[length] = byte3;
+            return length + 1;
+        }
+    };
+
+    /*
+     * Mouse Systems: three buttons, 8 data bits, no identification
+     *
+     * byte  d7   d6   d5   d4   d3   d2   d1   d0
+     *    1   1    0    0    0    0  !lb  !mb  !rb
+     *    2  dx1 (signed)
+     *    3  dy1 (signed, positive is up)
+     *    4  dx2 - motion after dx1
+     *    5  dy2 - motion after dy1
+     */
+    struct MouseSystems
+    {
+        static constexpr auto inline Identification = std::array<uint8_t, 0>{};
+        static constexpr auto inline DataBits = 8;
+        static constexpr auto inline MaxStep = 254;
+        static constexpr auto inline MaxWheel = 0;
+
+        static size_t Encode(const Packet& packet, Bytes& bytes)
+        {
+            uint8_t byte0 = 0b1000'0111;
+            if (packet.buttons & mouse::ButtonLeft) byte0 &= ~0b100;
+            if (packet.buttons & mouse::ButtonMiddle) byte0 &= ~0b010;
+            if (packet.buttons & mouse::ButtonRight) byte0 &= ~0b001;
+            // Both halves stay within -127..127
+            const auto x1 = packet.x / 2;
+            const auto y1 = -packet.y / 2;
+            bytes[0] = byte0;
+            bytes[1] = static_cast<uint8_t>(x1);
+            bytes[2] = static_cast<uint8_t>(y1);
+            bytes[3] = static_cast<uint8_t>(packet.x - x1);
+            bytes[4] = static_cast<uint8_t>(-packet.y - y1);
+            return 5;
+        }
+    };
+}
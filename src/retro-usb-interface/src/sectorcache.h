@@ -0,0 +1,228 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+
+enum class EvictionPolicy
+{
+    // Replace the line that was used longest ago
+    LeastRecentlyUsed,
+    // Replace the line that was inserted longest ago
+    FirstInFirstOut,
+};
+
+struct SectorCacheStatistics
+{
+    uint32_t hits{};
+    uint32_t misses{};
+    uint32_t evictions{};
+    uint32_t writes{};
+    uint32_t merged_writes{};
+    uint32_t written_back{};
+};
+
+/*
+ * Set-associative sector cache: sector n can only live in set (n % Sets), in
+ * any of its Ways lines. Sectors are identified by a Key, which can be wider
+ * than a sector number to tell multiple devices apart. All storage is part
+ * of the object, so the capacity is Sets * Ways sectors and nothing is
+ * allocated at runtime.
+ *
+ * Lines written using write() are dirty until mark_clean() is called; they
+ * are never chosen as a victim, so the owner must write them back (see
+ * needs_writeback()) before the set runs out of clean lines.
+ */
+template<size_t Sets, size_t Ways, EvictionPolicy Policy = EvictionPolicy::LeastRecentlyUsed, size_t SectorSize = 512, typename Key = uint32_t>
+class SectorCache
+{
+    static_assert(Sets > 0 && (Sets & (Sets - 1)) == 0, "number of sets must be a power of two");
+    static_assert(Ways > 0);
+
+    struct Line
+    {
+        Key sector{};
+        uint32_t stamp{};
+        bool valid{};
+        bool dirty{};
+        std::array<uint8_t, SectorSize> data{};
+    };
+    using Set = std::array<Line, Ways>;
+
+    std::array<Set, Sets> sets{};
+    uint32_t clock = 0;
+    SectorCacheStatistics stats{};
+
+    Set& set_for(Key sector)
+    {
+        return sets[sector & (Sets - 1)];
+    }
+
+    Line* find(Key sector)
+    {
+        for(auto& line: set_for(sector)) {
+            if (line.valid && line.sector == sector) return &line;
+        }
+        return nullptr;
+    }
+
+    // Picks the line to (re)use for sector: an existing copy, an unused line
+    // or the oldest clean line, in that order
+    Line* victim_for(Key sector)
+    {
+        if (auto line = find(sector); line) return line;
+
+        Line* victim = nullptr;
+        for(auto& line: set_for(sector)) {
+            if (!line.valid) return &line;
+            if (line.dirty) continue;
+            if (!victim || line.stamp < victim->stamp) victim = &line;
+        }
+        if (victim) ++stats.evictions;
+        return victim;
+    }
+
+    void store(Line& line, Key sector, const uint8_t* buffer)
+    {
+        line.sector = sector;
+        line.stamp = ++clock;
+        line.valid = true;
+        memcpy(line.data.data(), buffer, SectorSize);
+    }
+
+public:
+    static constexpr size_t capacity()
+    {
+        return Sets * Ways;
+    }
+
+    // Copies the sector to buffer if it is cached
+    bool lookup(Key sector, uint8_t* buffer)
+    {
+        auto line = find(sector);
+        if (!line) {
+            ++stats.misses;
+            return false;
+        }
+        if constexpr (Policy == EvictionPolicy::LeastRecentlyUsed) {
+            line->stamp = ++clock;
+        }
+        memcpy(buffer, line->data.data(), SectorSize);
+        ++stats.hits;
+        return true;
+    }
+
+    // True if storing sector requires dirty lines to be written back first
+    bool needs_writeback(Key sector)
+    {
+        if (find(sector)) return false;
+        for(const auto& line: set_for(sector)) {
+            if (!line.valid || !line.dirty) return false;
+        }
+        return true;
+    }
+
+    // Stores a sector as read from the device; must not replace a dirty copy
+    void insert(Key sector, const uint8_t* buffer)
+    {
+        auto line = victim_for(sector);
+        if (!line || line->dirty) return;
+        store(*line, sector, buffer);
+    }
+
+    // Stores a modified sector; false if the set first needs a write-back
+    bool write(Key sector, const uint8_t* buffer)
+    {
+        auto line = victim_for(sector);
+        if (!line) return false;
+        ++stats.writes;
+        if (line->dirty && line->sector == sector) ++stats.merged_writes;
+        store(*line, sector, buffer);
+        line->dirty = true;
+        return true;
+    }
+
+    // Lowest-numbered dirty sector, which is where a write-back run starts
+    std::optional<Key> first_dirty() const
+    {
+        std::optional<Key> first;
+        for(const auto& set: sets) {
+            for(const auto& line: set) {
+                if (line.valid && line.dirty && (!first || line.sector < *first)) first = line.sector;
+            }
+        }
+        return first;
+    }
+
+    // Contents of sector if it is dirty, nullptr otherwise
+    const uint8_t* dirty_data(Key sector)
+    {
+        auto line = find(sector);
+        return line && line->dirty ? line->data.data() : nullptr;
+    }
+
+    void mark_clean(Key sector)
+    {
+        if (auto line = find(sector); line && line->dirty) {
+            line->dirty = false;
+            ++stats.written_back;
+        }
+    }
+
+    size_t dirty_count() const
+    {
+        size_t count = 0;
+        for(const auto& set: sets) {
+            for(const auto& line: set) {
+                if (line.valid && line.dirty) ++count;
+            }
+        }
+        return count;
+    }
+
+    // Drops the sectors in [first, last]; returns how many were dirty
+    size_t invalidate(Key first, Key last)
+    {
+        size_t dirty = 0;
+        for(auto& set: sets) {
+            for(auto& line: set) {
+                if (!line.valid || line.sector < first || line.sector > last) continue;
+                if (line.dirty) ++dirty;
+                line.valid = false;
+                line.dirty = false;
+            }
+        }
+        return dirty;
+    }
+
+    const SectorCacheStatistics& statistics() const
+    {
+        return stats;
+    }
+};
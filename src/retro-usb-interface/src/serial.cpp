@@ -18,6 +18,18 @@
  * 4800 	*p
  * 2400 	*o
  * 1200 	*n
+ *
+ * The mouse switches as soon as the line is idle, which is well within the
+ * 0.1 seconds. Every mouse handshake (DTR going low) returns it to 1200.
+ *
+ * Protocol selection
+ * The protocol is chosen with "*P" followed by a digit: 0 = Microsoft,
+ * 1 = Logitech (the default), 2 = IntelliMouse, 3 = Mouse Systems. Like the
+ * 'm' key on the debug console, it takes effect with the next mouse
+ * handshake, which also sends the identification of the new protocol. The
+ * selection is not stored, so after power-up the mouse is a Logitech one
+ * again; a driver that wants another protocol sends "*P" before it resets
+ * the mouse.
  * 
  * Default: 1200N1, 7 bits
  *
@@ -50,19 +62,123 @@
  * https://web.stanford.edu/class/ee281/projects/aut2002/yingzong-mouse/media/Serial%20Mouse%20Detection.pdf
  * - 2.2.1.3
  * - 
+ *
+ * Storage protocol
+ * Sending "*^" while in mouse mode switches the port to 115200N1, 8 bits after
+ * replying "KO". The following requests are then understood (all numbers are
+ * big-endian):
+ *
+ *   'R' lba[4]            - read a single sector
+ *   'B' lba[4] count[1]   - read count (1..255) contiguous sectors
+ *   'W' lba[4] data[512] crc[2] - write a single sector
+ *   'F'                   - write all modified sectors to the device
+ *   'U' unit[1]           - select the drive unit used by further requests
+ *
+ * Every sector is answered with 512 data bytes followed by the CRC16-CCITT
+ * (polynomial 0x1021, initial value 0) of those bytes. A 'B' request streams
+ * its sectors back-to-back, so the client does not have to wait for a full
+ * request/response turnaround per sector.
+ *
+ * 'W', 'F' and 'U' are answered with a single byte: 'K' on success, 'C' if
+ * the CRC of the written data did not match or 'E' if the device reported an
+ * error (for 'U': the unit does not exist or holds no usable medium, in which
+ * case the selection does not change). Written sectors are kept in a
+ * write-back cache; they are flushed on 'F', when the port returns to mouse
+ * mode and after two idle seconds. A 'W' that needs room in the cache while
+ * write-back fails is answered with 'E', and its data is discarded.
+ *
+ * Drive units
+ * Every LUN of every attached mass storage device is a drive unit; a card
+ * reader with multiple slots thus provides multiple units. Units are numbered
+ * 0..3 in the order in which they are attached, and keep their number until
+ * they are removed. Unit 0 is selected when storage mode is entered. Requests
+ * for different units can be used back-to-back; windowed reads that are
+ * outstanding keep referring to the unit that was selected when they were
+ * sent. The write-back cache is shared: 'F' flushes all units.
+ *
+ * Link speed
+ * Storage mode always starts at 115200 baud. A client that can go faster
+ * sends
+ *
+ *   'S' rates[1]          - bit 0: 230400, bit 1: 460800, bit 2: 921600
+ *
+ * and the device replies 'K' followed by the selected rate code (0: 115200,
+ * 1: 230400, 2: 460800, 3: 921600), which is the highest rate both sides
+ * support. The device switches 10ms after the reply has been sent; the client
+ * switches as soon as it has read the reply and must not send anything for
+ * 20ms.
+ *
+ * The device counts CRC mismatches on writes as link errors. Once there are 4
+ * errors within 64 requests, it falls back to the next lower rate: the status
+ * byte of the 'W' is then preceded by 'D' and the new rate code, and both
+ * sides switch after the status byte. Falling back because of read errors is
+ * up to the client, which sees them (bad CRCs, 'e' responses, resends): it
+ * sends another 'S' request with fewer rates set. The device cannot announce
+ * a new rate in a read response, as 'R'/'B' data is not framed and windowed
+ * requests sent at the old rate may still be on their way.
+ *
+ * Extended handshake
+ * Instead of "*^", a client may send "*~" followed by a capabilities byte.
+ * The device replies "KO" followed by the subset of those capabilities it
+ * supports and then behaves as after "*^". Capabilities:
+ *
+ *   bit 0 - windowed reads
+ *   bit 1 - compressed sector data
+ *
+ * Windowed reads
+ * Up to 8 reads may be outstanding. Each carries a sequence number chosen by
+ * the client, which is echoed in its response; responses are sent in the
+ * order the requests arrived:
+ *
+ *   'r' seq[1] lba[4] crc[2] - read a sector; crc covers seq and lba
+ *   'n' seq[1] crc[2]        - resend the response to seq (i.e. bad CRC); crc
+ *                              covers seq
+ *
+ *   'd' seq[1] data[512] crc[2] - sector data; crc covers seq and data
+ *   'e'                         - the request arrived corrupted or the sector
+ *                                 could not be read; send the request again
+ *
+ * The sequence number of a corrupted request cannot be trusted, so 'e' does
+ * not carry one: like every response, it belongs to the oldest request that
+ * is still outstanding. An 'n' for a sequence number that has not been used
+ * by an 'r' is answered with 'e' as well.
+ *
+ * As the device processes the next request while the previous response is
+ * still being sent, the link stays busy as long as the client keeps the
+ * window filled. Only corrupted responses need to be asked for again.
+ *
+ * Compressed sector data
+ * With compression enabled, the 512 data bytes of every 'R', 'B' and 'd'
+ * response are replaced by a format byte and the payload as described in
+ * compress.h; incompressible sectors are sent as-is after a format byte of 0.
+ * The CRC then covers the format byte, payload length and payload instead.
  */
 
 #include "serial.h"
+#include <algorithm>
 #include <array>
+#include <cassert>
+#include <cinttypes>
 #include <cstdint>
 #include <cstdio>
+#include <optional>
+#include <span>
 #include <utility>
 #include "mouse.h"
+#include "mouseprotocol.h"
 #include "fifo.h"
+#include "crc16.h"
+#include "compress.h"
+#include "diskcache.h"
+#include "umass.h"
+#include "trace.h"
 #include "pico/stdlib.h"
+#include "hardware/dma.h"
 #include "hardware/sync.h"
 
-void umass_read_sector(uint32_t sector_nr, uint8_t* buffer);
+#ifndef UART_FIFO_ENABLED
+#define UART_FIFO_ENABLED 1
+#endif
 
 namespace serial 
 {
@@ -74,81 +190,797 @@ namespace serial
         static constexpr auto inline UART_TX = 4;
         static constexpr auto inline UART_RX = 5;
 
-        static constexpr auto inline UART_Mouse_Baudrate = 1'200;
-        static constexpr auto inline UART_Mouse_DataBits = 7;
+        // Interrupt level of the 32-byte PL011 RX FIFO, in UARTIFLS encoding
+        // (0 = 1/8, 1 = 1/4, 2 = 1/2, 3 = 3/4, 4 = 7/8 full). A partially
+        // filled RX FIFO is emptied by the receive timeout interrupt
+        static constexpr auto inline UART_RX_FifoLevel = 2;
+
+        // Index is the letter of the "*n".."*q" speed command; the first is the default
+        static constexpr auto inline UART_Mouse_Baudrates = std::to_array<uint32_t>({ 1'200, 2'400, 4'800, 9'600 });
+        static constexpr auto inline UART_Mouse_SpeedCommand = 'n';
+        // Followed by the protocol number as a digit
+        static constexpr auto inline UART_Mouse_ProtocolCommand = 'P';
         static constexpr auto inline UART_Mouse_StopBits = 1;
         static constexpr auto inline UART_Mouse_Parity = UART_PARITY_NONE;
 
-        static constexpr auto inline UART_Storage_Baudrate = 115'200;
+        // Index is the rate code of the 'S' request; the first is the default
+        static constexpr auto inline UART_Storage_Baudrates = std::to_array<uint32_t>({ 115'200, 230'400, 460'800, 921'600 });
         static constexpr auto inline UART_Storage_DataBits = 8;
         static constexpr auto inline UART_Storage_StopBits = 1;
         static constexpr auto inline UART_Storage_Parity = UART_PARITY_NONE;
     }
 
+    namespace storage {
+        // Sector numbers are relative to the first partition on the device
+        static constexpr auto inline PartitionOffset = 63;
+        static constexpr auto inline SectorSize = 512;
+        // 'W', sector number, data and CRC
+        static constexpr auto inline WriteRequestLength = 1 + 4 + SectorSize + 2;
+
+        static constexpr uint8_t inline ReplyOk = 'K';
+        static constexpr uint8_t inline ReplyCrcError = 'C';
+        static constexpr uint8_t inline ReplyDeviceError = 'E';
+        static constexpr uint8_t inline ReplyRateChange = 'D';
+        static constexpr uint8_t inline ReplyWindowedData = 'd';
+        static constexpr uint8_t inline ReplyWindowedError = 'e';
+
+        static constexpr uint8_t inline CapabilityWindowed = 0b0000'0001;
+        static constexpr uint8_t inline CapabilityCompression = 0b0000'0010;
+        static constexpr uint8_t inline Capabilities = CapabilityWindowed | CapabilityCompression;
+
+        // Maximum number of outstanding windowed reads
+        static constexpr auto inline WindowSize = 8;
+        // 'r', sequence number, sector number and CRC
+        static constexpr auto inline WindowedReadLength = 1 + 1 + 4 + 2;
+        // 'n', sequence number and CRC
+        static constexpr auto inline WindowedResendLength = 1 + 1 + 2;
+
+        // Fall back to a slower rate once this many link errors occur...
+        static constexpr auto inline LinkErrorThreshold = 4;
+        // ... within this many requests
+        static constexpr auto inline LinkErrorWindow = 64;
+        // Time for the client to reprogram its UART after a rate change
+        static constexpr auto inline RateChangeDelayMs = 10;
+    }
+
+    namespace dma {
+        // SNIFF_CTRL.CALC value for CRC-16-CCITT, which matches crc16::Update()
+        static constexpr auto inline SnifferCRC16 = 0x2;
+    }
+
     namespace {
-        Fifo<16> transmitFifo;
-        Fifo<16> receiveFifo;
-        std::array<uint8_t, 512> sector_buffer;
-
-        uint16_t UpdateCRC16(uint16_t crc, uint8_t byte)
-        {
-            crc = crc ^ (byte << 8);
-            for(int n = 0; n < 8; ++n) {
-                const auto carry = crc & 0x8000;
-                crc = crc << 1;
-                if (carry) {
-                    crc = crc ^ 0x1021;
+        // Must be able to hold a complete write request
+        Fifo<1024> receiveFifo;
+        // While one buffer is transmitted by DMA, the next sector is read into the other
+        std::array<std::array<uint8_t, storage::SectorSize>, 2> sector_buffers;
+        // Compressed versions of sector_buffers, if compression is enabled
+        std::array<std::array<uint8_t, storage::SectorSize>, 2> compressed_buffers;
+        int txDmaChannel = -1;
+        serial::UartStatistics uartStats;
+
+        /*
+         * Everything sent to the host is described by a TransmitDescriptor and
+         * sent by DMA, straight from the producer's buffer; the buffer must
+         * stay intact until the completion is called. Small replies are
+         * copied into the descriptor instead.
+         *
+         * Mouse packets have their own queue, which is served first whenever
+         * a descriptor is done, so they never wait behind bulk data. They are
+         * only sent in mouse mode, so they cannot end up inside a storage
+         * reply.
+         */
+        using TransmitCompletion = void (*)(bool success, uintptr_t context);
+
+        struct TransmitDescriptor
+        {
+            const uint8_t* data{};
+            size_t length{};
+            // Sent instead of data if that is nullptr
+            std::array<uint8_t, 6> bytes{};
+            // If set, the DMA sniffer calculates the CRC of the data, starting at this value
+            std::optional<uint16_t> crcSeed;
+            TransmitCompletion completion{};
+            uintptr_t context{};
+        };
+
+        enum class TransmitQueue { Bulk, Mouse };
+
+        struct Transmitter
+        {
+            Fifo<8, TransmitDescriptor> bulk;
+            Fifo<8, TransmitDescriptor> mouse;
+            std::optional<TransmitDescriptor> current;
+            // Line model: when the last byte handed to the UART will have
+            // been sent, as the UART cannot tell
+            uint32_t baudrate{};
+            uint32_t bitsPerByte{};
+            uint32_t lineIdle_us{};
+
+            bool Idle() const
+            {
+                return !current && bulk.empty() && mouse.empty();
+            }
+        };
+        Transmitter transmitter;
+
+        // Mouse packets that are queued for transmission, for latency statistics
+        struct MousePacket
+        {
+            mouse::MouseEvent event;
+            uint32_t enqueued_us{};
+        };
+        Fifo<16, MousePacket> mousePackets;
+
+        // A serial mouse moves one step per two USB counts
+        static constexpr auto inline MouseCountsPerStep = 2;
+
+        // The selected protocol takes effect with the next mouse handshake
+        struct MouseProtocol
+        {
+            mouseprotocol::Protocol active{ mouseprotocol::Protocol::Logitech };
+            mouseprotocol::Protocol selected{ mouseprotocol::Protocol::Logitech };
+        };
+        MouseProtocol mouseProtocol;
+
+        // Calls f with the encoder of the active protocol, which specializes
+        // the code using it for every protocol
+        template<typename Function>
+        void WithMouseEncoder(Function&& f)
+        {
+            using mouseprotocol::Protocol;
+            switch(mouseProtocol.active) {
+                case Protocol::Microsoft: f(mouseprotocol::Microsoft{}); break;
+                case Protocol::Logitech: f(mouseprotocol::Logitech{}); break;
+                case Protocol::IntelliMouse: f(mouseprotocol::IntelliMouse{}); break;
+                case Protocol::MouseSystems: f(mouseprotocol::MouseSystems{}); break;
+            }
+        }
+
+        /*
+         * Mouse state that has not been sent yet; only used on core0. Packets
+         * are built from it when the line is about to become idle, so every
+         * packet carries the latest motion instead of queueing up behind
+         * older ones.
+         */
+        struct PendingMouse
+        {
+            mouse::MotionAccumulator motion{ MouseCountsPerStep };
+            // Every button state gets its own packet, in order, so a click
+            // shorter than a packet is not lost. If more changes arrive than
+            // fit, the packets only catch up to the latest state
+            Fifo<16> buttonChanges;
+            uint8_t buttons{};
+            uint8_t sentButtons{};
+            int32_t wheel{};
+            // Oldest event that is not completely sent, for latency statistics
+            std::optional<mouse::MouseEvent> oldest;
+
+            // Whether the host has been told everything
+            bool Sent() const
+            {
+                return buttonChanges.empty() && buttons == sentButtons && !motion.pending() && wheel == 0;
+            }
+
+            void Reset()
+            {
+                motion.Reset();
+                buttonChanges.clear();
+                buttons = 0;
+                sentButtons = 0;
+                wheel = 0;
+                oldest.reset();
+            }
+        };
+        PendingMouse pendingMouse;
+
+        // Completion of every descriptor in the mouse queue; they complete in order
+        void OnMousePacketSent(bool success, uintptr_t)
+        {
+            const auto packet = mousePackets.pop();
+            // Runs before the next transmission starts, so the line model ends with this packet
+            if (success) mouse::RecordLatency(packet.event, packet.enqueued_us, transmitter.lineIdle_us);
+        }
+
+        /*
+         * Sector reads that still have to be answered: a run of count sectors
+         * for 'R' and 'B', or a single one with a sequence number for windowed
+         * reads. A corrupt windowed request only results in an error reply.
+         */
+        struct SectorRead
+        {
+            uint32_t sector_nr{};
+            uint32_t count{};
+            std::optional<uint8_t> seq;
+            bool corrupt{};
+            uint8_t unit{};
+        };
+
+        /*
+         * Every sector is handed to the transmitter as a header, its data and
+         * the CRC; the DMA sniffer calculates the CRC while the data is sent.
+         * Meanwhile, the next read is processed into the other buffer, which
+         * can be queued behind it right away.
+         */
+        struct SectorStream
+        {
+            struct Buffer
+            {
+                enum class State { Empty, Reading, Read, Ready, Sending };
+                State state{};
+                std::optional<uint8_t> seq;
+                bool corrupt{};
+                bool failed{};
+                std::optional<compress::Result> compressed;
+            };
+            // Room for a full window plus a retransmission for each entry
+            Fifo<storage::WindowSize * 2, SectorRead> reads;
+            std::array<Buffer, 2> buffers;
+            size_t fill{};
+            // CRC of the sector whose data was sent last; this is always sent
+            // before the data of the next sector completes
+            std::array<uint8_t, 2> crcBytes{};
+            // Incremented on abort, so that stale read completions are ignored
+            uintptr_t generation{};
+            // Set while core1 may write into the sector buffer; unlike the
+            // buffer state, this outlives an abort
+            std::array<bool, 2> readInFlight{};
+
+            bool Active() const
+            {
+                if (!reads.empty()) return true;
+                // A stale read must not complete into a sector buffer that
+                // is in use again, for a new stream or a received sector
+                for(const auto inFlight: readInFlight) {
+                    if (inFlight) return true;
+                }
+                for(const auto& buffer: buffers) {
+                    if (buffer.state != Buffer::State::Empty) return true;
                 }
+                return false;
             }
-            return crc;
+
+            bool CanQueue() const
+            {
+                return reads.bytes_left() < storage::WindowSize * 2;
+            }
+        };
+        SectorStream sectorStream;
+        // Sector requested for each windowed sequence number, for retransmission
+        struct WindowedSector
+        {
+            bool requested{};
+            uint8_t unit{};
+            uint32_t sector_nr{};
+        };
+        std::array<WindowedSector, 256> windowedSectors;
+
+        struct StorageLink
+        {
+            bool active{};
+            bool windowed{};
+            bool compressed{};
+            bool flushPending{};
+            std::optional<bool> flushResult;
+            // The write-back started to make room for a 'W' failed
+            bool writeBackFailed{};
+            size_t rate{};
+            // Highest rate that is still considered reliable
+            size_t ceiling = pin::UART_Storage_Baudrates.size() - 1;
+            // Write CRC errors within the last LinkErrorWindow requests
+            int requests{};
+            int errors{};
+            // Announced by the next status byte
+            std::optional<size_t> pendingRate;
+            // Drive unit used by all requests
+            uint8_t unit{};
+
+            void Reset()
+            {
+                *this = {};
+            }
+
+            void OnRequest()
+            {
+                if (++requests < storage::LinkErrorWindow) return;
+                requests = 0;
+                errors = 0;
+            }
+
+            void OnError()
+            {
+                if (++errors < storage::LinkErrorThreshold || rate == 0) return;
+                ceiling = rate - 1;
+                pendingRate = ceiling;
+                requests = 0;
+                errors = 0;
+            }
+        };
+        StorageLink storageLink;
+
+        void StartTransmission(const TransmitDescriptor& descriptor)
+        {
+            dma_channel_config c = dma_channel_get_default_config(txDmaChannel);
+            channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+            channel_config_set_read_increment(&c, true);
+            channel_config_set_write_increment(&c, false);
+            channel_config_set_dreq(&c, uart_get_dreq(pin::UART, true));
+            channel_config_set_sniff_enable(&c, descriptor.crcSeed.has_value());
+
+            if (descriptor.crcSeed) {
+                dma_sniffer_enable(txDmaChannel, dma::SnifferCRC16, true);
+                dma_sniffer_set_data_accumulator(*descriptor.crcSeed);
+            }
+            const auto data = descriptor.data ? descriptor.data : descriptor.bytes.data();
+            dma_channel_configure(txDmaChannel, &c, &uart_get_hw(pin::UART)->dr, data, descriptor.length, true);
+
+            const auto now = time_us_32();
+            if (static_cast<int32_t>(transmitter.lineIdle_us - now) < 0) transmitter.lineIdle_us = now;
+            transmitter.lineIdle_us += static_cast<uint32_t>((static_cast<uint64_t>(descriptor.length) * transmitter.bitsPerByte * 1'000'000) / transmitter.baudrate);
+        }
+
+        // Completes the current descriptor if it has been sent, and starts
+        // the next one. Completions run before the next transfer starts, so
+        // they can still read the sniffer
+        void RunTransmitter()
+        {
+            if (transmitter.current) {
+                if (dma_channel_is_busy(txDmaChannel)) return;
+                const auto done = *transmitter.current;
+                transmitter.current.reset();
+                uartStats.transmitted += done.length;
+                if (done.completion) done.completion(true, done.context);
+            }
+
+            auto& queue = transmitter.mouse.empty() ? transmitter.bulk : transmitter.mouse;
+            if (queue.empty()) return;
+            transmitter.current = queue.pop();
+            StartTransmission(*transmitter.current);
+        }
+
+        bool CanTransmit(size_t descriptors, TransmitQueue queue = TransmitQueue::Bulk)
+        {
+            const auto& fifo = queue == TransmitQueue::Mouse ? transmitter.mouse : transmitter.bulk;
+            return fifo.space_left() >= descriptors;
+        }
+
+        // False if the queue is full, in which case the caller must try again
+        bool Transmit(const TransmitDescriptor& descriptor, TransmitQueue queue = TransmitQueue::Bulk)
+        {
+            auto& fifo = queue == TransmitQueue::Mouse ? transmitter.mouse : transmitter.bulk;
+            if (!fifo.push(TransmitDescriptor{descriptor})) return false;
+            // Only start right away if that does not complete another descriptor
+            if (!transmitter.current) RunTransmitter();
+            return true;
+        }
+
+        bool TransmitBytes(std::span<const uint8_t> bytes, TransmitQueue queue = TransmitQueue::Bulk, TransmitCompletion completion = {})
+        {
+            TransmitDescriptor descriptor{ .length = bytes.size(), .completion = completion };
+            assert(bytes.size() <= descriptor.bytes.size());
+            std::copy(bytes.begin(), bytes.end(), descriptor.bytes.begin());
+            if (Transmit(descriptor, queue)) return true;
+            printf("serial: transmit queue full, dropping %zu byte(s)\n", bytes.size());
+            return false;
+        }
+
+        // Stops sending and cancels everything queued
+        void AbortTransmission()
+        {
+            if (transmitter.current) {
+                dma_channel_abort(txDmaChannel);
+            }
+            const auto cancel = [](const TransmitDescriptor& descriptor) {
+                if (descriptor.completion) descriptor.completion(false, descriptor.context);
+            };
+            if (const auto current = std::exchange(transmitter.current, std::nullopt); current) cancel(*current);
+            while(!transmitter.mouse.empty()) cancel(transmitter.mouse.pop());
+            while(!transmitter.bulk.empty()) cancel(transmitter.bulk.pop());
+        }
+
+        // Waits until everything queued has left the UART
+        void WaitForTransmitter()
+        {
+            while(!transmitter.Idle()) {
+                RunTransmitter();
+            }
+            uart_tx_wait_blocking(pin::UART);
         }
 
         void ResetUart(int baudrate, int dataBits, int stopBits, uart_parity_t parity)
         {
-            int x = uart_init(pin::UART, baudrate);
+            AbortTransmission();
+            // The receive FIFO can only be cleared while the IRQ handler is not using it
+            irq_set_enabled(pin::UART_IRQ, false);
+            transmitter.baudrate = uart_init(pin::UART, baudrate);
+            transmitter.bitsPerByte = 1 + dataBits + (parity != UART_PARITY_NONE ? 1 : 0) + stopBits;
+            transmitter.lineIdle_us = time_us_32();
             uart_set_format(pin::UART, dataBits, stopBits, parity);
-            uart_set_fifo_enabled(pin::UART, false);
-            // TX IRQ will be enabled once it is needed
-            uart_set_irq_enables(pin::UART, true, false);
+            uart_set_fifo_enabled(pin::UART, UART_FIFO_ENABLED);
+            uart_get_hw(pin::UART)->ifls = pin::UART_RX_FifoLevel << UART_UARTIFLS_RXIFLSEL_LSB;
+            // Not uart_set_irq_enables(), as that also resets the FIFO level.
+            // Transmission is done by DMA, so there is no TX interrupt
+            uart_get_hw(pin::UART)->imsc = UART_UARTIMSC_RXIM_BITS | UART_UARTIMSC_RTIM_BITS;
 
-            transmitFifo.clear();
             receiveFifo.clear();
+            irq_set_enabled(pin::UART_IRQ, true);
+        }
+
+        void SwitchStorageRate(size_t rate)
+        {
+            // The UART must be done with the reply before the rate changes
+            WaitForTransmitter();
+            sleep_ms(storage::RateChangeDelayMs);
+            storageLink.rate = rate;
+            storageLink.pendingRate.reset();
+            ResetUart(pin::UART_Storage_Baudrates[rate], pin::UART_Storage_DataBits, pin::UART_Storage_StopBits, pin::UART_Storage_Parity);
+            printf("serial: storage link now at %" PRIu32 " baud\n", pin::UART_Storage_Baudrates[rate]);
+        }
+
+        uint32_t PeekUint32(size_t offset)
+        {
+            uint32_t value = static_cast<uint32_t>(receiveFifo.peek(offset + 0)) << 24;
+            value |= static_cast<uint32_t>(receiveFifo.peek(offset + 1)) << 16;
+            value |= static_cast<uint32_t>(receiveFifo.peek(offset + 2)) << 8;
+            value |= static_cast<uint32_t>(receiveFifo.peek(offset + 3)) << 0;
+            return value;
+        }
+
+        uint32_t PopUint32()
+        {
+            const auto value = PeekUint32(0);
+            receiveFifo.drop(4);
+            return value;
+        }
+
+        uint16_t PopUint16()
+        {
+            uint16_t value = static_cast<uint16_t>(receiveFifo.pop()) << 8;
+            value |= receiveFifo.pop();
+            return value;
+        }
+
+        void QueueSectorRead(const SectorRead& read)
+        {
+            sectorStream.reads.push(SectorRead{read});
+        }
+
+        void AbortSectorStream()
+        {
+            // A read that is still in progress completes into the now unused
+            // buffer, which is not reused until then (see Active()); cancelled
+            // transmissions are ignored likewise
+            ++sectorStream.generation;
+            AbortTransmission();
+            sectorStream.reads.clear();
+            for(auto& buffer: sectorStream.buffers) {
+                buffer.state = SectorStream::Buffer::State::Empty;
+            }
+        }
+
+        void OnSectorRead(bool success, uintptr_t context)
+        {
+            sectorStream.readInFlight[context & 1] = false;
+            if ((context >> 1) != sectorStream.generation) return;
+            auto& buffer = sectorStream.buffers[context & 1];
+            if (buffer.state != SectorStream::Buffer::State::Reading) return;
+            buffer.failed = !success;
+            buffer.state = SectorStream::Buffer::State::Read;
+        }
+
+        // The sector data has been sent, so its buffer can be reused
+        void OnSectorSent(bool success, uintptr_t context)
+        {
+            if ((context >> 1) != sectorStream.generation) return;
+            auto& buffer = sectorStream.buffers[context & 1];
+            if (success) {
+                auto crc = static_cast<uint16_t>(dma_sniffer_get_data_accumulator());
+                // A sector that could not be read goes out with a bad CRC,
+                // so legacy clients will request it again
+                if (buffer.failed) crc = ~crc;
+                sectorStream.crcBytes = { static_cast<uint8_t>(crc >> 8), static_cast<uint8_t>(crc & 0xff) };
+            }
+            buffer.state = SectorStream::Buffer::State::Empty;
+        }
+
+        // Advances the sector stream as far as possible without waiting for
+        // the UART or USB device.
+        void RunSectorStream()
+        {
+            using State = SectorStream::Buffer::State;
+            auto& stream = sectorStream;
+
+            auto& buffer = stream.buffers[stream.fill];
+            if (buffer.state == State::Empty && !stream.readInFlight[stream.fill] && !stream.reads.empty()) {
+                auto& read = stream.reads.front();
+                const auto sector_nr = read.sector_nr++;
+                buffer = { .state = State::Reading, .seq = read.seq, .corrupt = read.corrupt };
+                if (read.corrupt || --read.count == 0) stream.reads.drop(1);
+                if (buffer.corrupt) {
+                    buffer.state = State::Ready;
+                } else {
+                    // Overlaps with the DMA transfer of the previous sector, if any
+                    stream.readInFlight[stream.fill] = true;
+                    diskcache::ReadSector(read.unit, sector_nr + storage::PartitionOffset, sector_buffers[stream.fill].data(), OnSectorRead, (stream.generation << 1) | stream.fill);
+                }
+            }
+
+            if (buffer.state == State::Read) {
+                if (storageLink.compressed && !buffer.failed) {
+                    buffer.compressed = compress::Compress(sector_buffers[stream.fill].data(), compressed_buffers[stream.fill].data());
+                }
+                buffer.state = State::Ready;
+            }
+
+            // Header, data and CRC
+            if (buffer.state != State::Ready || !CanTransmit(3)) return;
+            if (buffer.corrupt || (buffer.failed && buffer.seq)) {
+                // Ask the client to try again
+                TransmitBytes(std::to_array<uint8_t>({ storage::ReplyWindowedError }));
+                buffer.state = State::Empty;
+            } else {
+                std::array<uint8_t, 5> header;
+                size_t headerLength = 0;
+                uint16_t crc = 0;
+                const auto addHeaderByte = [&](uint8_t b) {
+                    header[headerLength++] = b;
+                    crc = crc16::Update(crc, b);
+                };
+                if (buffer.seq) {
+                    header[headerLength++] = storage::ReplyWindowedData;
+                    addHeaderByte(*buffer.seq);
+                }
+
+                const uint8_t* payload = sector_buffers[stream.fill].data();
+                size_t length = storage::SectorSize;
+                if (storageLink.compressed) {
+                    const auto result = buffer.compressed.value_or(compress::Result{ compress::Format::Raw, storage::SectorSize });
+                    addHeaderByte(static_cast<uint8_t>(result.format));
+                    if (result.format != compress::Format::Raw) {
+                        payload = compressed_buffers[stream.fill].data();
+                        length = result.length;
+                    }
+                    if (result.format == compress::Format::RLE || result.format == compress::Format::LZ) {
+                        addHeaderByte(length >> 8);
+                        addHeaderByte(length & 0xff);
+                    }
+                }
+                if (headerLength > 0) TransmitBytes(std::span{ header }.first(headerLength));
+                Transmit({ .data = payload, .length = length, .crcSeed = crc, .completion = OnSectorSent, .context = (stream.generation << 1) | stream.fill });
+                Transmit({ .data = stream.crcBytes.data(), .length = stream.crcBytes.size() });
+                trace::Trace<trace::Event::SectorQueued>(length, crc);
+                buffer.state = State::Sending;
+            }
+            stream.fill ^= 1;
+        }
+
+        // Moves all complete windowed requests from the receive FIFO to the sector stream
+        void ParseWindowedRequests()
+        {
+            while(sectorStream.CanQueue() && !receiveFifo.empty()) {
+                const auto len = receiveFifo.bytes_left();
+                const auto request = receiveFifo.peek(0);
+                if (request == 'r' && len >= storage::WindowedReadLength) {
+                    receiveFifo.drop(1);
+                    storageLink.OnRequest();
+                    const auto seq = receiveFifo.pop();
+                    const auto sector_nr = PopUint32();
+                    const auto expected_crc = PopUint16();
+
+                    uint16_t crc = crc16::Update(0, seq);
+                    for(int shift = 24; shift >= 0; shift -= 8) {
+                        crc = crc16::Update(crc, static_cast<uint8_t>(sector_nr >> shift));
+                    }
+                    if (crc != expected_crc) {
+                        QueueSectorRead({ .corrupt = true });
+                        continue;
+                    }
+                    trace::Trace<trace::Event::StorageWindowedRead>(sector_nr, seq);
+                    windowedSectors[seq] = { .requested = true, .unit = storageLink.unit, .sector_nr = sector_nr };
+                    QueueSectorRead({ .sector_nr = sector_nr, .count = 1, .seq = seq, .unit = storageLink.unit });
+                } else if (request == 'n' && len >= storage::WindowedResendLength) {
+                    receiveFifo.drop(1);
+                    const auto seq = receiveFifo.pop();
+                    const auto expected_crc = PopUint16();
+                    const auto& windowed = windowedSectors[seq];
+                    if (crc16::Update(0, seq) != expected_crc || !windowed.requested) {
+                        // Resending whatever the corrupted sequence number refers to would be wrong
+                        QueueSectorRead({ .corrupt = true });
+                        continue;
+                    }
+                    QueueSectorRead({ .sector_nr = windowed.sector_nr, .count = 1, .seq = seq, .unit = windowed.unit });
+                } else {
+                    break;
+                }
+            }
+        }
+
+        uint8_t ReceiveSector(uint8_t unit, uint32_t device_sector_nr)
+        {
+            auto& sector_buffer = sector_buffers[0];
+            for(auto& b: sector_buffer) {
+                b = receiveFifo.pop();
+            }
+            const auto crc = crc16::Update(0, sector_buffer.data(), sector_buffer.size());
+            const auto expected_crc = PopUint16();
+            if (crc != expected_crc) return storage::ReplyCrcError;
+
+            diskcache::WriteSector(unit, device_sector_nr, sector_buffer.data());
+            return storage::ReplyOk;
+        }
+
+        // Sends the status byte of a 'W'/'F'/'U' request, signalling a pending
+        // rate fallback first
+        void SendStatus(uint8_t status)
+        {
+            const auto newRate = storageLink.pendingRate;
+            if (newRate) {
+                TransmitBytes(std::to_array<uint8_t>({ storage::ReplyRateChange, static_cast<uint8_t>(*newRate), status }));
+            } else {
+                TransmitBytes({ &status, 1 });
+            }
+            if (newRate) {
+                SwitchStorageRate(*newRate);
+            }
+        }
+
+        size_t SelectStorageRate(uint8_t clientRates)
+        {
+            for(auto rate = storageLink.ceiling; rate > 0; --rate) {
+                if (clientRates & (1 << (rate - 1))) return rate;
+            }
+            return 0;
+        }
+
+        void OnFlushDone(bool success, uintptr_t)
+        {
+            storageLink.flushResult = success;
+        }
+
+        void OnWriteBackDone(bool success, uintptr_t)
+        {
+            if (!success) storageLink.writeBackFailed = true;
+        }
+
+        bool IsStorageRequest(uint8_t ch)
+        {
+            if (storageLink.windowed && (ch == 'r' || ch == 'n')) return true;
+            return ch == 'R' || ch == 'B' || ch == 'W' || ch == 'F' || ch == 'S' || ch == 'U' || ch == '*';
+        }
+
+        // Handshakes and mouse commands are sent with 7 data bits. While an
+        // 8-bit mouse protocol is active, their stop bit arrives as bit 7
+        uint8_t PeekCommand(size_t offset)
+        {
+            const auto b = receiveFifo.peek(offset);
+            return storageLink.active ? b : b & 0x7f;
         }
 
+        // True if the receive FIFO holds the start of a "*^" or "*~" handshake
+        bool IsPartialHandshake(size_t len)
+        {
+            if (len == 0 || PeekCommand(0) != '*') return false;
+            return len == 1 || (len == 2 && PeekCommand(1) == '~');
+        }
+
+        bool IsMouseSpeedCommand(size_t len)
+        {
+            if (len < 2 || PeekCommand(0) != '*') return false;
+            const auto speed = PeekCommand(1) - pin::UART_Mouse_SpeedCommand;
+            return speed >= 0 && speed < static_cast<int>(pin::UART_Mouse_Baudrates.size());
+        }
+
+        // "*P" and a digit; "*P" alone may still be completed
+        std::optional<mouseprotocol::Protocol> ParseMouseProtocolCommand(size_t len, bool& partial)
+        {
+            partial = false;
+            if (len < 2 || PeekCommand(0) != '*' || PeekCommand(1) != pin::UART_Mouse_ProtocolCommand) return {};
+            if (len == 2) {
+                partial = true;
+                return {};
+            }
+            const auto protocol = PeekCommand(2) - '0';
+            if (protocol < 0 || protocol >= mouseprotocol::ProtocolCount) return {};
+            return static_cast<mouseprotocol::Protocol>(protocol);
+        }
+
+        void ResetMouseUart(size_t speed)
+        {
+            WithMouseEncoder([&](auto encoder) {
+                ResetUart(pin::UART_Mouse_Baudrates[speed], decltype(encoder)::DataBits, pin::UART_Mouse_StopBits, pin::UART_Mouse_Parity);
+            });
+        }
 
-        void TransmitEnqueuedByte()
+        void SwitchMouseSpeed(size_t speed)
         {
-            const auto ch = transmitFifo.pop();
-            uart_putc_raw(pin::UART, ch);
-            uart_set_irq_enables(pin::UART, true, !transmitFifo.empty());
+            // A packet on its way still goes out at the old speed
+            WaitForTransmitter();
+            ResetMouseUart(speed);
+            printf("serial: mouse now at %" PRIu32 " baud\n", pin::UART_Mouse_Baudrates[speed]);
         }
 
-        void EnqueueByte(uint8_t ch)
+        void EnterStorageMode(uint8_t capabilities)
         {
-            const auto bufferEmpty = transmitFifo.empty();
-            transmitFifo.push(std::move(ch));
-            if (bufferEmpty) {
-                TransmitEnqueuedByte();
+            storageLink.Reset();
+            storageLink.active = true;
+            storageLink.windowed = capabilities & storage::CapabilityWindowed;
+            storageLink.compressed = capabilities & storage::CapabilityCompression;
+            windowedSectors = {};
+            AbortSectorStream();
+            ResetUart(pin::UART_Storage_Baudrates[0], pin::UART_Storage_DataBits, pin::UART_Storage_StopBits, pin::UART_Storage_Parity);
+        }
+
+        // Sends the next mouse packet once the previous one is almost on the
+        // wire; button changes go first
+        template<typename Encoder>
+        void SendMousePacket()
+        {
+            auto& pending = pendingMouse;
+            if constexpr (Encoder::MaxWheel == 0) pending.wheel = 0;
+            if (pending.Sent()) {
+                // Events that left nothing to send (i.e. motion below a step)
+                // must not count towards the latency of a later packet
+                pending.oldest.reset();
+                return;
             }
+            if (!mousePackets.empty() || !CanTransmit(1, TransmitQueue::Mouse)) return;
+            // Building the packet while the last byte before it goes out keeps the line busy
+            const auto now = time_us_32();
+            const auto byte_us = transmitter.bitsPerByte * 1'000'000 / transmitter.baudrate;
+            if (static_cast<int32_t>(transmitter.lineIdle_us - now) > static_cast<int32_t>(byte_us)) return;
+
+            const auto step = pending.motion.Next(Encoder::MaxStep);
+            const mouseprotocol::Packet packet{
+                .x = step.x,
+                .y = step.y,
+                .wheel = std::clamp<int32_t>(pending.wheel, -Encoder::MaxWheel, Encoder::MaxWheel),
+                .buttons = pending.buttonChanges.empty() ? pending.buttons : pending.buttonChanges.pop(),
+                .previousButtons = pending.sentButtons,
+            };
+            mouseprotocol::Bytes bytes;
+            const auto length = Encoder::Encode(packet, bytes);
+            TransmitBytes(std::span{ bytes }.first(length), TransmitQueue::Mouse, OnMousePacketSent);
+            mousePackets.push({ *pending.oldest, now });
+            pending.motion.Consume(step);
+            pending.wheel -= packet.wheel;
+            pending.sentButtons = packet.buttons;
+            // The rest of a split packet still belongs to the same events
+            if (pending.Sent()) pending.oldest.reset();
         }
     }
 
     void OnUartIrq()
     {
+        ++uartStats.interrupts;
+        uint32_t received = 0, dropped = 0;
+        // Emptying the RX FIFO clears both the RX and receive timeout interrupts
         while(uart_is_readable(pin::UART)) {
-            auto ch = uart_getc(pin::UART);
-            printf("{%x}", ch);
-            receiveFifo.push(std::move(ch));
-        }
-
-        if (uart_is_writable(pin::UART)) {
-            if (transmitFifo.empty()) {
-                // Disable TX-empty interrupt, we have nothing left to send
-                uart_set_irq_enables(pin::UART, true, false);
+            if (receiveFifo.push(uart_getc(pin::UART))) {
+                ++received;
             } else {
-                TransmitEnqueuedByte();
+                ++dropped;
             }
         }
+        uartStats.received += received;
+        uartStats.dropped += dropped;
+        trace::Trace<trace::Event::UartIrq>(received, dropped);
+    }
+
+    UartStatistics GetUartStatistics()
+    {
+        irq_set_enabled(pin::UART_IRQ, false);
+        const auto stats = uartStats;
+        irq_set_enabled(pin::UART_IRQ, true);
+        return stats;
+    }
+
+    void SelectMouseProtocol(mouseprotocol::Protocol protocol)
+    {
+        mouseProtocol.selected = protocol;
+    }
+
+    mouseprotocol::Protocol GetSelectedMouseProtocol()
+    {
+        return mouseProtocol.selected;
     }
 
     SerialMouse::SerialMouse()
@@ -158,85 +990,168 @@ namespace serial
         gpio_set_function(pin::UART_RX, GPIO_FUNC_UART);
         gpio_set_function(pin::UART_TX, GPIO_FUNC_UART);
 
+        txDmaChannel = dma_claim_unused_channel(true);
+
         irq_set_exclusive_handler(pin::UART_IRQ, OnUartIrq);
         irq_set_enabled(pin::UART_IRQ, true);
         // Resets the port to 1200N1, for mice
-        ResetUart(pin::UART_Mouse_Baudrate, pin::UART_Mouse_DataBits, pin::UART_Mouse_StopBits, pin::UART_Mouse_Parity);
+        ResetMouseUart(0);
     }
 
     void SerialMouse::SendEvent(const mouse::MouseEvent& event)
     {
-        const auto x = event.delta_x / 2;
-        const auto y = event.delta_y / 2;
+        // Mouse packets would end up in the middle of storage replies
+        if (storageLink.active) return;
 
-        /*
-         *
-         * byte  d6   d5   d4   d3   d2   d1   d0
-         *    1   1   lb   rb  dy7  dy6  dx7  dx6
-         *    2   0  dx5  dx4  dx3  dx2  dx1  dx0
-         *    3   0  dy5  dy4  dy3  dy2  dy1  dy0
-         *   (4   0    1    0    0    0    0    0) - if middle button is down
-         */
-        uint8_t byte0 = 0b100'0000;
-        if (event.button & mouse::ButtonLeft) byte0 |= 0b010'0000;
-        if (event.button & mouse::ButtonRight) byte0 |= 0b001'0000;
-        byte0 |= ((y >> 6) & 0b11) << 2;
-        byte0 |= ((x >> 6) & 0b11) << 0;
-
-        const uint8_t byte1 = (x & 0b0011'1111);
-        const uint8_t byte2 = (y & 0b0011'1111);
-        const uint8_t byte3 = (event.button & mouse::ButtonMiddle) ? 0b010'0000 : 0;
-
-        irq_set_enabled(pin::UART_IRQ, false);
-        EnqueueByte(byte0);
-        EnqueueByte(byte1);
-        EnqueueByte(byte2);
-        if (byte3) EnqueueByte(byte3);
-        irq_set_enabled(pin::UART_IRQ, true);
+        // Sent by Run() once the line is ready for it
+        auto& pending = pendingMouse;
+        pending.motion.Add(event.delta_x, event.delta_y);
+        pending.wheel += event.wheel;
+        if (event.button != pending.buttons) {
+            pending.buttonChanges.push(uint8_t{event.button});
+            pending.buttons = event.button;
+        }
+        if (!pending.oldest) pending.oldest = event;
     }
 
     void SerialMouse::Run()
     {
+        RunTransmitter();
+
         const auto dtr = gpio_get(pin::DTR);
         if (std::exchange(previous_dtr_state, dtr) != dtr && !dtr) {
             printf("serial: sending mouse handshake\n");
-            irq_set_enabled(pin::UART_IRQ, false);
-            ResetUart(pin::UART_Mouse_Baudrate, pin::UART_Mouse_DataBits, pin::UART_Mouse_StopBits, pin::UART_Mouse_Parity);
-            EnqueueByte('M');
-            EnqueueByte('3');
-            irq_set_enabled(pin::UART_IRQ, true);
+            AbortSectorStream();
+            diskcache::Flush();
+            storageLink.Reset();
+            pendingMouse.Reset();
+            mouseProtocol.active = mouseProtocol.selected;
+            ResetMouseUart(0);
+            WithMouseEncoder([](auto encoder) {
+                using Encoder = decltype(encoder);
+                if constexpr (Encoder::Identification.size() > 0) TransmitBytes(Encoder::Identification);
+            });
             return;
         }
 
-        irq_set_enabled(pin::UART_IRQ, false);
+        if (!storageLink.active) {
+            WithMouseEncoder([](auto encoder) { SendMousePacket<decltype(encoder)>(); });
+        }
+
+        if (storageLink.windowed) {
+            // Windowed requests are accepted while earlier ones are still being answered
+            ParseWindowedRequests();
+        }
+
         const auto len = receiveFifo.bytes_left();
-        if (len >= 2 && receiveFifo.peek(0) == '*' && receiveFifo.peek(1) == '^') {
+        if (sectorStream.Active() || storageLink.flushPending) {
+            // Requests are handled one at a time
+        } else if (len >= 2 && PeekCommand(0) == '*' && PeekCommand(1) == '^') {
             printf("serial: got umass handshake\n");
             // Use a busy-waiting send here - we need to ensure the bytes
-            // receive their target before we reprogram the UART
+            // receive their target before we reprogram the UART. Pending
+            // mouse packets are of no use to the storage client
+            AbortTransmission();
             uart_write_blocking(pin::UART, reinterpret_cast<const uint8_t*>("KO"), 2);
 
             // Give remove side some time to read the data before we clear the FIFO
             sleep_ms(100);
 
             // Reprogram to storage mode
-            ResetUart(pin::UART_Storage_Baudrate, pin::UART_Storage_DataBits, pin::UART_Storage_StopBits, pin::UART_Storage_Parity);
+            EnterStorageMode(0);
+        } else if (len >= 3 && PeekCommand(0) == '*' && PeekCommand(1) == '~') {
+            const uint8_t capabilities = receiveFifo.peek(2) & storage::Capabilities;
+            printf("serial: got extended umass handshake, capabilities %x\n", capabilities);
+            const std::array<uint8_t, 3> reply{ 'K', 'O', capabilities };
+            AbortTransmission();
+            uart_write_blocking(pin::UART, reply.data(), reply.size());
+            sleep_ms(100);
+            EnterStorageMode(capabilities);
+        } else if (!storageLink.active && IsMouseSpeedCommand(len)) {
+            const size_t speed = PeekCommand(1) - pin::UART_Mouse_SpeedCommand;
+            receiveFifo.drop(2);
+            SwitchMouseSpeed(speed);
+        } else if (!storageLink.active) {
+            // Mouse mode: only the handshakes, speed and protocol commands are of interest
+            bool partial;
+            if (const auto protocol = ParseMouseProtocolCommand(len, partial); protocol) {
+                receiveFifo.drop(3);
+                SelectMouseProtocol(*protocol);
+                printf("serial: mouse protocol %s selected\n", mouseprotocol::ProtocolNames[static_cast<int>(*protocol)]);
+            } else if (len >= 1 && !partial && !IsPartialHandshake(len)) {
+                receiveFifo.drop(1);
+            }
+        } else if (len >= 1 && (!IsStorageRequest(receiveFifo.peek(0)) || (receiveFifo.peek(0) == '*' && !IsPartialHandshake(len)))) {
+            trace::Trace<trace::Event::StorageUnexpectedByte>(receiveFifo.peek(0), len);
+            receiveFifo.drop(1);
+        } else if (len >= 2 && receiveFifo.peek(0) == 'S') {
+            receiveFifo.drop(1);
+            const auto rate = SelectStorageRate(receiveFifo.pop());
+            storageLink.OnRequest();
+            TransmitBytes(std::to_array<uint8_t>({ storage::ReplyOk, static_cast<uint8_t>(rate) }));
+            SwitchStorageRate(rate);
         } else if (len >= 5 && receiveFifo.peek(0) == 'R') {
             receiveFifo.drop(1);
-            uint32_t sector_nr = static_cast<uint32_t>(receiveFifo.pop()) << 24;
-            sector_nr |= static_cast<uint32_t>(receiveFifo.pop()) << 16;
-            sector_nr |= static_cast<uint32_t>(receiveFifo.pop()) << 8;
-            sector_nr |= static_cast<uint32_t>(receiveFifo.pop()) << 0;
-            printf("serial: receive %d\n", sector_nr);
-            umass_read_sector(sector_nr + 63, sector_buffer.data());
-            uint16_t crc = 0;
-            for(size_t n = 0; n < sector_buffer.size(); ++n) {
-                EnqueueByte(sector_buffer[n]);
-                crc = UpdateCRC16(crc, sector_buffer[n]);
-            }
-            EnqueueByte(crc >> 8);
-            EnqueueByte(crc & 0xff);
+            storageLink.OnRequest();
+            const auto sector_nr = PopUint32();
+            trace::Trace<trace::Event::StorageRead>(sector_nr, 1);
+            QueueSectorRead({ .sector_nr = sector_nr, .count = 1, .unit = storageLink.unit });
+        } else if (len >= 6 && receiveFifo.peek(0) == 'B') {
+            receiveFifo.drop(1);
+            storageLink.OnRequest();
+            const auto sector_nr = PopUint32();
+            const auto count = receiveFifo.pop();
+            trace::Trace<trace::Event::StorageRead>(sector_nr, count);
+            if (count > 0) {
+                QueueSectorRead({ .sector_nr = sector_nr, .count = count, .unit = storageLink.unit });
+            }
+        } else if (len >= storage::WriteRequestLength && receiveFifo.peek(0) == 'W') {
+            const auto device_sector_nr = PeekUint32(1) + storage::PartitionOffset;
+            if (!diskcache::CanWrite(storageLink.unit, device_sector_nr)) {
+                // Leave the request queued until write-back has made room. If
+                // that fails (i.e. a write-protected medium), the lines stay
+                // modified, so the request is rejected instead
+                if (diskcache::IsFlushing()) {
+                    // Wait for the write-back to finish
+                } else if (std::exchange(storageLink.writeBackFailed, false)) {
+                    receiveFifo.drop(storage::WriteRequestLength);
+                    storageLink.OnRequest();
+                    trace::Trace<trace::Event::StorageWrite>(device_sector_nr - storage::PartitionOffset, storage::ReplyDeviceError);
+                    SendStatus(storage::ReplyDeviceError);
+                } else {
+                    diskcache::Flush(OnWriteBackDone, 0);
+                }
+            } else {
+                receiveFifo.drop(1 + 4);
+                storageLink.OnRequest();
+                const auto status = ReceiveSector(storageLink.unit, device_sector_nr);
+                trace::Trace<trace::Event::StorageWrite>(device_sector_nr - storage::PartitionOffset, status);
+                if (status == storage::ReplyCrcError) storageLink.OnError();
+                SendStatus(status);
+            }
+        } else if (len >= 1 && receiveFifo.peek(0) == 'F') {
+            receiveFifo.drop(1);
+            storageLink.OnRequest();
+            trace::Trace<trace::Event::StorageFlush>();
+            storageLink.flushPending = true;
+            diskcache::Flush(OnFlushDone, 0);
+        } else if (len >= 2 && receiveFifo.peek(0) == 'U') {
+            receiveFifo.drop(1);
+            storageLink.OnRequest();
+            const auto unit = receiveFifo.pop();
+            const auto ready = umass::IsReady(unit);
+            trace::Trace<trace::Event::StorageSelectUnit>(unit, ready);
+            if (ready) storageLink.unit = unit;
+            SendStatus(ready ? storage::ReplyOk : storage::ReplyDeviceError);
         }
-        irq_set_enabled(pin::UART_IRQ, true);
+
+        if (storageLink.flushPending && storageLink.flushResult) {
+            SendStatus(*storageLink.flushResult ? storage::ReplyOk : storage::ReplyDeviceError);
+            storageLink.flushPending = false;
+            storageLink.flushResult.reset();
+        }
+
+        RunSectorStream();
+        RunTransmitter();
     }
 }
\ No newline at end of file
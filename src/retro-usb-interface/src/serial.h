@@ -24,13 +24,30 @@
  */
 #pragma once
 
+#include <cstdint>
+
 namespace mouse
 {
     struct MouseEvent;
 }
 
+namespace mouseprotocol
+{
+    enum class Protocol : uint8_t;
+}
+
 namespace serial
 {
+    struct UartStatistics
+    {
+        uint32_t interrupts{};
+        uint32_t received{};
+        // Received while the receive FIFO was full
+        uint32_t dropped{};
+        // Counted once a transmission has been handed to the UART completely
+        uint32_t transmitted{};
+    };
+
     struct SerialMouse
     {
         bool previous_dtr_state{};
@@ -39,4 +56,10 @@ namespace serial
         void Run();
         void SendEvent(const mouse::MouseEvent& event);
     };
+
+    UartStatistics GetUartStatistics();
+
+    // Takes effect with the next mouse handshake, when the host identifies the mouse again
+    void SelectMouseProtocol(mouseprotocol::Protocol protocol);
+    mouseprotocol::Protocol GetSelectedMouseProtocol();
 }
\ No newline at end of file
@@ -0,0 +1,148 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "trace.h"
+#include <array>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+namespace trace
+{
+    namespace
+    {
+        // Records per core; must be a power of two
+        static constexpr auto inline RingSize = 256;
+        // Records formatted per ring and call to Run(), so that output does
+        // not hold up the main loop
+        static constexpr auto inline RecordsPerRun = 2;
+
+        struct Ring
+        {
+            std::array<Record, RingSize> records{};
+            // Only advanced by the core that owns the ring
+            std::atomic<uint32_t> head{};
+            // Only used by core0
+            uint32_t tail{};
+            uint32_t lost{};
+        };
+        std::array<Ring, 2> rings;
+        Output output = Output::None;
+
+        // Copies the oldest unread record; false if there is none (yet)
+        bool Fetch(Ring& ring, Record& result)
+        {
+            const auto head = ring.head.load(std::memory_order_acquire);
+            if (head - ring.tail > RingSize) {
+                // Overwritten before it could be read
+                ring.lost += head - ring.tail - RingSize;
+                ring.tail = head - RingSize;
+            }
+            if (ring.tail == head) return false;
+
+            auto& record = ring.records[ring.tail & (RingSize - 1)];
+            std::atomic_ref sequence{ record.sequence };
+            const auto expected = ring.tail + 1;
+            const auto before = sequence.load(std::memory_order_acquire);
+            if (before != expected) {
+                // Either still being written, or already overwritten by a later record
+                if (before == 0 || static_cast<int32_t>(before - expected) < 0) return false;
+                ++ring.lost;
+                ++ring.tail;
+                return false;
+            }
+            result = record;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            ++ring.tail;
+            if (sequence.load(std::memory_order_relaxed) != before) {
+                ++ring.lost;
+                return false;
+            }
+            return true;
+        }
+
+        void Print(unsigned core, const Record& record)
+        {
+            if (output == Output::Hex) {
+                printf("T %u %08" PRIx32 " %04x %08" PRIx32 " %08" PRIx32 "\n", core, record.timestamp_us, record.event, record.arg0, record.arg1);
+                return;
+            }
+            std::array<char, 128> line;
+            Format(line.data(), line.size(), core, record);
+            printf("%s\n", line.data());
+        }
+    }
+
+    void Emit(Event event, uint32_t arg0, uint32_t arg1)
+    {
+        auto& ring = rings[get_core_num()];
+        // The IRQ handlers of this core are the only other writers
+        const auto status = save_and_disable_interrupts();
+        const auto index = ring.head.load(std::memory_order_relaxed);
+        ring.head.store(index + 1, std::memory_order_relaxed);
+        restore_interrupts(status);
+
+        auto& record = ring.records[index & (RingSize - 1)];
+        std::atomic_ref sequence{ record.sequence };
+        sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        record.timestamp_us = time_us_32();
+        record.event = static_cast<uint16_t>(event);
+        record.arg0 = arg0;
+        record.arg1 = arg1;
+        sequence.store(index + 1, std::memory_order_release);
+    }
+
+    void SetOutput(Output newOutput)
+    {
+        output = newOutput;
+    }
+
+    Output GetOutput()
+    {
+        return output;
+    }
+
+    void Run()
+    {
+        if (output == Output::None) return;
+        for(unsigned core = 0; core < rings.size(); ++core) {
+            auto& ring = rings[core];
+            Record record;
+            for(int n = 0; n < RecordsPerRun && Fetch(ring, record); ++n) {
+                Print(core, record);
+            }
+            if (ring.lost > 0) {
+                if (output == Output::Hex) {
+                    printf("T! %u %" PRIu32 "\n", core, ring.lost);
+                } else {
+                    printf("trace: core%u: %" PRIu32 " records lost\n", core, ring.lost);
+                }
+                ring.lost = 0;
+            }
+        }
+    }
+}
@@ -0,0 +1,160 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+/*
+ * Binary tracing. Trace points store a fixed-size record (timestamp, event
+ * and two arguments) in a RAM ring of the core they run on; this is cheap
+ * enough for interrupt handlers and per-sector paths. The records are
+ * formatted later by trace::Run() on core0, or dumped as hex and turned into
+ * text on the host by tools/tracedecode.cpp.
+ *
+ * This header is shared with the host decoder, so it must not depend on the
+ * Pico SDK.
+ *
+ * TRACE_CATEGORIES is a mask of the categories that are compiled in; trace
+ * points of other categories generate no code at all.
+ */
+#ifndef TRACE_CATEGORIES
+#define TRACE_CATEGORIES 0xffffffff
+#endif
+
+namespace trace
+{
+    enum class Category : uint32_t
+    {
+        Uart = 1 << 0,
+        Storage = 1 << 1,
+        Umass = 1 << 2,
+        Mouse = 1 << 3,
+    };
+
+    // Values are part of the dump format; only append
+    enum class Event : uint16_t
+    {
+        UartIrq,
+        StorageRead,
+        StorageWindowedRead,
+        StorageWrite,
+        StorageFlush,
+        StorageSelectUnit,
+        StorageUnexpectedByte,
+        SectorQueued,
+        UmassIssue,
+        UmassComplete,
+        MouseEvent,
+        Count
+    };
+
+    struct EventInfo
+    {
+        Category category;
+        const char* name;
+        // Formats the two arguments, as %lu or %lx
+        const char* format;
+    };
+
+    inline constexpr std::array<EventInfo, static_cast<size_t>(Event::Count)> Events{{
+        { Category::Uart, "uart", "irq, %lu bytes received, %lu dropped" },
+        { Category::Storage, "storage", "read %lu, %lu sectors" },
+        { Category::Storage, "storage", "windowed read %lu, sequence %lu" },
+        { Category::Storage, "storage", "write %lu, status %lu" },
+        { Category::Storage, "storage", "flush" },
+        { Category::Storage, "storage", "select unit %lu, ready %lu" },
+        { Category::Storage, "storage", "dropping unexpected byte %lx, %lu bytes pending" },
+        { Category::Storage, "storage", "sector queued for transmission, %lu bytes, crc seed %lx" },
+        { Category::Umass, "umass", "unit %lu: issue block %lu" },
+        { Category::Umass, "umass", "unit %lu: done, passed %lu" },
+        { Category::Mouse, "mouse", "event, delta %04lx (yyxx), buttons %lx" },
+    }};
+
+    struct Record
+    {
+        // Index of the record plus one once it is complete; 0 while written
+        uint32_t sequence;
+        uint32_t timestamp_us;
+        uint16_t event;
+        uint16_t reserved;
+        uint32_t arg0;
+        uint32_t arg1;
+    };
+
+    constexpr bool IsEnabled(Category category)
+    {
+        return (TRACE_CATEGORIES & static_cast<uint32_t>(category)) != 0;
+    }
+
+    constexpr const EventInfo& Describe(Event event)
+    {
+        return Events[static_cast<size_t>(event)];
+    }
+
+    // Formats a record as a line of text, i.e. "[   12.345678] core0 storage: read 5, 1 sectors"
+    inline int Format(char* buffer, size_t size, unsigned core, const Record& record)
+    {
+        const auto length = snprintf(buffer, size, "[%5lu.%06lu] core%u ",
+            static_cast<unsigned long>(record.timestamp_us / 1'000'000), static_cast<unsigned long>(record.timestamp_us % 1'000'000), core);
+        if (length < 0 || static_cast<size_t>(length) >= size) return length;
+        if (record.event >= Events.size()) {
+            return length + snprintf(buffer + length, size - length, "unknown event %u: %lx %lx", record.event,
+                static_cast<unsigned long>(record.arg0), static_cast<unsigned long>(record.arg1));
+        }
+        const auto& info = Events[record.event];
+        const auto nameLength = snprintf(buffer + length, size - length, "%s: ", info.name);
+        if (nameLength < 0 || static_cast<size_t>(length + nameLength) >= size) return length + nameLength;
+        return length + nameLength + snprintf(buffer + length + nameLength, size - length - nameLength, info.format,
+            static_cast<unsigned long>(record.arg0), static_cast<unsigned long>(record.arg1));
+    }
+
+    void Emit(Event event, uint32_t arg0, uint32_t arg1);
+
+    template<Event E>
+    inline void Trace(uint32_t arg0 = 0, uint32_t arg1 = 0)
+    {
+        if constexpr (IsEnabled(Describe(E).category)) {
+            Emit(E, arg0, arg1);
+        }
+    }
+
+    enum class Output
+    {
+        // Records are kept; once the ring is full, the oldest are overwritten
+        None,
+        Text,
+        // One line per record, for tools/tracedecode
+        Hex,
+    };
+
+    void SetOutput(Output output);
+    Output GetOutput();
+
+    // Formats a few records at a time; call from the core0 main loop
+    void Run();
+}
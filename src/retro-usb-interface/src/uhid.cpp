@@ -27,6 +27,7 @@
 #include <optional>
 #include "tusb.h"
 #include "mouse.h"
+#include "pico/time.h"
 
 namespace
 {
@@ -36,13 +37,13 @@ namespace
         uint8_t instance{};
         hid_mouse_report_t prev_report = { };
 
-        void processMouseReport(const hid_mouse_report_t& report);
+        void processMouseReport(const hid_mouse_report_t& report, uint32_t received_us);
     };
 
     std::optional<HidMouse> hidMouse;
 }
 
-void HidMouse::processMouseReport(const hid_mouse_report_t& report)
+void HidMouse::processMouseReport(const hid_mouse_report_t& report, uint32_t received_us)
 {
     uint8_t button{};
     if (report.buttons & MOUSE_BUTTON_LEFT) button |= mouse::ButtonLeft;
@@ -51,7 +52,9 @@ void HidMouse::processMouseReport(const hid_mouse_report_t& report)
     mouse::OnNewEvent({
         .delta_x = report.x,
         .delta_y = report.y,
-        .button = button
+        .wheel = report.wheel,
+        .button = button,
+        .report_us = received_us
     });
 }
 
@@ -65,7 +68,7 @@ void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t instance, const uint8_t* desc_re
 {
     const auto itf_protocol = tuh_hid_interface_protocol(dev_addr, instance);
     if (itf_protocol == HID_ITF_PROTOCOL_MOUSE) {
-        printf("hid address %d instance %d: accepted boot mouse protocol\n", dev_addr, instance, itf_protocol);
+        printf("hid address %d instance %d: accepted boot mouse protocol\n", dev_addr, instance);
         hidMouse.emplace(dev_addr, instance);
 
         // request to receive report
@@ -93,6 +96,7 @@ void tuh_hid_umount_cb(uint8_t dev_addr, uint8_t instance)
 // Invoked when received report from device via interrupt endpoint
 void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const* report, uint16_t len)
 {
+    const auto received_us = time_us_32();
     assert(hidMouse);
     assert(hidMouse->dev_addr == dev_addr);
     assert(hidMouse->instance == instance);
@@ -105,7 +109,7 @@ void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t cons
 
         case HID_ITF_PROTOCOL_MOUSE:
             // printf("hid: dev_addr %d instance %d, received boot mouse report\n", dev_addr, instance);
-            hidMouse->processMouseReport(*reinterpret_cast<const hid_mouse_report_t*>(report));
+            hidMouse->processMouseReport(*reinterpret_cast<const hid_mouse_report_t*>(report), received_us);
             break;
 
         default:
@@ -24,65 +24,461 @@
  *
  */
 #include <cstdio>
+#include <cinttypes>
 #include <cstdint>
+#include <cstring>
+#include <algorithm>
 #include <optional>
 #include <atomic>
 #include <array>
 
 #include "tusb.h"
+#include "umass.h"
+#include "fifo.h"
+#include "corequeue.h"
+#include "diskcache.h"
+#include "trace.h"
+#include "pico/stdlib.h"
+#include "pico/mutex.h"
 
 namespace
 {
-    struct MassDevice
+    static constexpr auto inline SectorSize = 512;
+    // Number of sectors that are fetched ahead once sequential access is detected
+    static constexpr auto inline ReadAheadDepth = 4;
+    // Maximum number of requests waiting to be issued to a unit
+    static constexpr auto inline QueueDepth = 8;
+    // Largest native block size supported; must be a multiple of SectorSize
+    static constexpr auto inline MaxBlockSize = 4096;
+    // Completions and other notifications waiting to be handled by core0
+    static constexpr auto inline NotificationDepth = 128;
+
+    /*
+     * umass::Run() and all TinyUSB callbacks run on core1, while requests
+     * are submitted and completed on core0. Every completion (or other work
+     * that belongs to core0) is passed back as a notification.
+     */
+    struct Notification
     {
-        uint8_t dev_addr{};
-        uint8_t lun{};
-        std::atomic<bool> done{};
+        umass::Completion completion{};
+        uintptr_t context{};
+        bool success{};
+    };
+    CoreQueue<NotificationDepth, Notification> notifications;
+
+    void Notify(umass::Completion completion, uintptr_t context, bool success)
+    {
+        // core0 always catches up, and notifications must not get lost
+        while(!notifications.push({ .completion = completion, .context = context, .success = success })) {
+            tight_loop_contents();
+        }
+    }
+
+    enum class Operation
+    {
+        ReadCapacity,
+        Read,
+        Write,
+        ReadAhead,
+    };
+
+    struct Request
+    {
+        Operation op{};
+        uint32_t sector_nr{};
+        uint32_t count{};
+        uint8_t* buffer{};
+        umass::Completion completion{};
+        uintptr_t context{};
+        // Set once read-ahead has looked at the request
+        bool checked{};
+        // Set for requests made by umass itself; these complete on core1
+        bool local{};
+
+        // Called once count sectors have been transferred
+        bool Advance(uint32_t sectors)
+        {
+            sector_nr += sectors;
+            count -= sectors;
+            buffer += sectors * SectorSize;
+            return count == 0;
+        }
+
+        void Complete(bool success) const
+        {
+            if (!completion) return;
+            if (local) {
+                completion(success, context);
+            } else {
+                Notify(completion, context, success);
+            }
+        }
+    };
+
+    enum class Step
+    {
+        // Command that is not a sector transfer
+        Command,
+        // Whole blocks, transferred directly from/to the request buffer
+        Direct,
+        // Reads a native block into blockBuffer
+        FillBlock,
+        // Writes blockBuffer back to its native block
+        WriteBlock,
+    };
+
+    struct Inflight
+    {
+        Step step{};
+        uint32_t block{};
+        // Sectors of the request that are done once this step succeeds
+        uint32_t sectors{};
+    };
+
+    /*
+     * The read-ahead ring holds the sectors [first, first + valid) in the
+     * slots starting at head. A ReadAhead request fills the slot directly
+     * after the last valid one with sector first + valid; these are only
+     * issued while no other requests are waiting.
+     */
+    struct ReadAhead
+    {
+        std::array<std::array<uint8_t, SectorSize>, ReadAheadDepth> slots;
+        uint32_t first{};
+        size_t head{};
+        size_t valid{};
+        bool active{};
+        std::optional<uint32_t> previous_sector;
+        umass::ReadAheadStatistics stats;
+
+        auto& Slot(size_t n) { return slots[(head + n) % slots.size()]; }
+
+        void Reset(uint32_t next_sector)
+        {
+            stats.discarded += valid;
+            first = next_sector;
+            head = 0;
+            valid = 0;
+        }
+
+        void Consume(size_t amount)
+        {
+            head = (head + amount) % slots.size();
+            first += amount;
+            valid -= amount;
+        }
+
+        std::optional<Request> NextRequest()
+        {
+            if (!active || valid == slots.size()) return {};
+            return Request{ .op = Operation::ReadAhead, .sector_nr = static_cast<uint32_t>(first + valid), .count = 1, .buffer = Slot(valid).data() };
+        }
 
-        void WaitUntilDone()
+        // Serves a single-sector read from the ring; false if it must go to the device
+        bool Serve(const Request& request)
         {
-            while(!done) {
-                tuh_task();
+            const auto sector_nr = request.sector_nr;
+            const auto sequential = previous_sector && *previous_sector + 1 == sector_nr;
+            previous_sector = sector_nr;
+
+            if (active && request.count == 1 && sector_nr >= first && sector_nr < first + valid) {
+                ++stats.hits;
+                const auto skipped = sector_nr - first;
+                stats.discarded += skipped;
+                Consume(skipped);
+                memcpy(request.buffer, Slot(0).data(), SectorSize);
+                Consume(1);
+                return true;
+            }
+
+            ++stats.misses;
+            Reset(sector_nr + request.count);
+            active = sequential;
+            return false;
+        }
+
+        void OnTransferDone(bool passed)
+        {
+            if (passed) {
+                ++valid;
+                ++stats.prefetched;
+            } else {
+                // Stop reading ahead; the next request will restart it if needed
+                active = false;
             }
         }
     };
-    std::array<uint8_t, 512> transferBuffer;
+    /*
+     * A unit is a single LUN of a mass storage device; a card reader with
+     * multiple slots yields multiple units. Every unit has its own queue and
+     * read-ahead, so requests for different devices are in progress on the
+     * bus at the same time. LUNs of the same device share a single bulk
+     * pipe and thus take turns, as tuh_msc_ready() is false while any
+     * command is outstanding on the device.
+     */
+    struct Unit
+    {
+        uint8_t dev_addr{};
+        uint8_t lun{};
+        // Set once the medium has been found usable
+        bool ready{};
+        // Number of 512-byte sectors per native block
+        uint32_t sectors_per_block = 1;
+
+        // Requests taken from the unit's channel; the request at the head of
+        // the queue is the one being worked on
+        Fifo<QueueDepth, Request> requests;
+        std::optional<Inflight> inflight;
+        std::atomic<bool> inflightDone{};
+        bool inflightPassed{};
+        ReadAhead readAhead;
+
+        /*
+         * Media with native blocks larger than 512 bytes are accessed through
+         * blockBuffer: a partial block is read once, and the remaining sectors
+         * of that block are then served without a USB transfer. Partial block
+         * writes are done using read-modify-write on the same buffer.
+         */
+        std::array<uint8_t, MaxBlockSize> blockBuffer;
+        std::optional<uint32_t> blockBufferBlock;
+
+        scsi_read_capacity10_resp_t capacity;
+        std::array<uint8_t, SectorSize> transferBuffer;
+
+        Unit(uint8_t dev_addr, uint8_t lun) : dev_addr(dev_addr), lun(lun) { }
+    };
+    std::array<std::optional<Unit>, umass::MaxUnits> units;
+
+    /*
+     * The part of a unit that is shared with core0. It stays while units
+     * come and go: core0 may have just submitted a request to a unit that is
+     * being removed, which core1 then fails.
+     */
+    struct Channel
+    {
+        CoreQueue<QueueDepth, Request> submitted;
+        std::atomic<bool> ready{};
 
-    std::optional<MassDevice> massDevice;
+        // Copies of core1 statistics, for core0
+        umass::ReadAheadStatistics readAhead{};
+        QueueStatistics submissions{};
+    };
+    std::array<Channel, umass::MaxUnits> channels;
+    auto_init_mutex(statisticsMutex);
+    // Unit that is looked at first by Run(), so LUNs of a device are served in turn
+    size_t firstUnit = 0;
 
-    bool msc_callback([[maybe_unused]] uint8_t dev_addr, [[maybe_unused]] const tuh_msc_complete_data_t* cb_data)
+    bool msc_callback([[maybe_unused]] uint8_t dev_addr, const tuh_msc_complete_data_t* cb_data)
     {
-        assert(massDevice);
-        assert(massDevice->dev_addr == dev_addr);
-        massDevice->done = true;
+        auto& unit = units[cb_data->user_arg];
+        assert(unit);
+        assert(unit->dev_addr == dev_addr);
+        unit->inflightPassed = cb_data->csw->status == MSC_CSW_STATUS_PASSED;
+        unit->inflightDone = true;
         return true;
     }
-}
 
-extern "C" void tuh_msc_mount_cb(uint8_t dev_addr)
-{
-    if (massDevice) {
-        printf("umass: ignoring mount of device, address %d (already attached device %d)\n", dev_addr, massDevice->dev_addr);
-        return;
-    }
-    printf("umass: mounted device, address %d\n", dev_addr);
-    massDevice.emplace(dev_addr);
-
-    scsi_inquiry_resp_t inquiry_resp;
-    massDevice->done = false;
-    tuh_msc_inquiry(massDevice->dev_addr, massDevice->lun, &inquiry_resp, msc_callback, 0);
-    massDevice->WaitUntilDone();
-
-    const auto block_count = tuh_msc_get_block_count(dev_addr, massDevice->lun);
-    const auto block_size = tuh_msc_get_block_size(dev_addr, massDevice->lun);
-    printf("umass: %lu blocks of %lu bytes, total size %lu MB\n", block_count, block_size, block_count / ((1024 * 1024) / block_size));
-    if (block_size == transferBuffer.size()) {
-        massDevice->done = false;
-        tuh_msc_read10(massDevice->dev_addr, massDevice->lun, transferBuffer.data(), 0, 1, msc_callback, 0);
-        massDevice->WaitUntilDone();
+    void CompleteHead(Unit& unit, bool success)
+    {
+        const auto request = unit.requests.pop();
+        if (request.op == Operation::ReadAhead) {
+            unit.readAhead.OnTransferDone(success);
+        } else {
+            request.Complete(success);
+        }
+    }
+
+    bool Issue(size_t unitNr, const Inflight& step, const Request& request)
+    {
+        auto& unit = *units[unitNr];
+        unit.inflightDone = false;
+        const auto dev_addr = unit.dev_addr;
+        const auto lun = unit.lun;
+        const auto spb = unit.sectors_per_block;
+        const auto isWrite = request.op == Operation::Write;
+        bool issued = false;
+        switch(step.step) {
+            case Step::Command:
+                issued = tuh_msc_read_capacity(dev_addr, lun, &unit.capacity, msc_callback, unitNr);
+                break;
+            case Step::Direct:
+                if (isWrite) {
+                    issued = tuh_msc_write10(dev_addr, lun, request.buffer, step.block, step.sectors / spb, msc_callback, unitNr);
+                } else {
+                    issued = tuh_msc_read10(dev_addr, lun, request.buffer, step.block, step.sectors / spb, msc_callback, unitNr);
+                }
+                break;
+            case Step::FillBlock:
+                issued = tuh_msc_read10(dev_addr, lun, unit.blockBuffer.data(), step.block, 1, msc_callback, unitNr);
+                break;
+            case Step::WriteBlock:
+                issued = tuh_msc_write10(dev_addr, lun, unit.blockBuffer.data(), step.block, 1, msc_callback, unitNr);
+                break;
+        }
+        if (issued) {
+            unit.inflight = step;
+            trace::Trace<trace::Event::UmassIssue>(unitNr, step.block);
+        }
+        return issued;
+    }
 
+    void OnStepDone(Unit& unit, const Inflight& step, bool passed)
+    {
+        if (!passed) {
+            if (step.step != Step::Command) unit.blockBufferBlock.reset();
+            CompleteHead(unit, false);
+            return;
+        }
+
+        auto& request = unit.requests.front();
+        switch(step.step) {
+            case Step::Command:
+                CompleteHead(unit, true);
+                break;
+            case Step::Direct: {
+                const auto spb = unit.sectors_per_block;
+                if (request.op == Operation::Write && unit.blockBufferBlock &&
+                    *unit.blockBufferBlock >= step.block && *unit.blockBufferBlock < step.block + step.sectors / spb) {
+                    unit.blockBufferBlock.reset();
+                }
+                if (request.Advance(step.sectors)) CompleteHead(unit, true);
+                break;
+            }
+            case Step::FillBlock:
+                // The request itself progresses on the next Run()
+                unit.blockBufferBlock = step.block;
+                break;
+            case Step::WriteBlock:
+                if (request.Advance(step.sectors)) CompleteHead(unit, true);
+                break;
+        }
+    }
+
+    /*
+     * Makes progress on the request at the head of the queue. Returns true
+     * if it may be possible to continue right away, i.e. because sectors
+     * were copied from blockBuffer or the request was completed.
+     */
+    bool RunHead(size_t unitNr)
+    {
+        auto& unit = *units[unitNr];
+        auto& request = unit.requests.front();
+        if (!request.checked) {
+            request.checked = true;
+            if (request.op == Operation::Read && unit.readAhead.Serve(request)) {
+                CompleteHead(unit, true);
+                return true;
+            }
+            if (request.op == Operation::Write) {
+                // Anything read ahead may be overwritten by this write
+                unit.readAhead.active = false;
+                unit.readAhead.Reset(request.sector_nr);
+            }
+        }
+
+        if (!tuh_msc_ready(unit.dev_addr)) return false;
+        if (request.op == Operation::ReadCapacity) {
+            Issue(unitNr, { .step = Step::Command }, request);
+            return false;
+        }
+
+        const auto spb = unit.sectors_per_block;
+        const auto block = request.sector_nr / spb;
+        const auto index = request.sector_nr % spb;
+        if (index == 0 && request.count >= spb) {
+            const auto blocks = std::min<uint32_t>(request.count / spb, UINT16_MAX);
+            Issue(unitNr, { .step = Step::Direct, .block = block, .sectors = blocks * spb }, request);
+            return false;
+        }
+
+        // Part of a single native block
+        const auto sectors = std::min(request.count, spb - index);
+        if (unit.blockBufferBlock != block) {
+            Issue(unitNr, { .step = Step::FillBlock, .block = block }, request);
+            return false;
+        }
+        auto blockData = &unit.blockBuffer[index * SectorSize];
+        if (request.op == Operation::Write) {
+            memcpy(blockData, request.buffer, sectors * SectorSize);
+            Issue(unitNr, { .step = Step::WriteBlock, .block = block, .sectors = sectors }, request);
+            return false;
+        }
+        memcpy(request.buffer, blockData, sectors * SectorSize);
+        if (request.Advance(sectors)) CompleteHead(unit, true);
+        return true;
+    }
+
+    void PublishStatistics(size_t unitNr)
+    {
+        auto& channel = channels[unitNr];
+        mutex_enter_blocking(&statisticsMutex);
+        channel.readAhead = units[unitNr]->readAhead.stats;
+        channel.submissions = channel.submitted.statistics();
+        mutex_exit(&statisticsMutex);
+    }
+
+    void RunUnit(size_t unitNr)
+    {
+        auto& unit = *units[unitNr];
+        auto& channel = channels[unitNr];
+        while(!unit.requests.full()) {
+            auto request = channel.submitted.pop();
+            if (!request) break;
+            unit.requests.push(std::move(*request));
+        }
+        PublishStatistics(unitNr);
+
+        if (unit.inflight && unit.inflightDone) {
+            const auto step = *unit.inflight;
+            unit.inflight.reset();
+            trace::Trace<trace::Event::UmassComplete>(unitNr, unit.inflightPassed);
+            OnStepDone(unit, step, unit.inflightPassed);
+        }
+        if (unit.inflight) return;
+
+        if (unit.requests.empty()) {
+            if (const auto next = unit.readAhead.NextRequest(); next) {
+                unit.requests.push(Request{*next});
+            }
+        }
+        while(!unit.requests.empty() && !unit.inflight && RunHead(unitNr)) {
+        }
+    }
+
+    bool Submit(uint8_t unitNr, const Request& request)
+    {
+        if (unitNr >= channels.size()) return false;
+        auto& channel = channels[unitNr];
+        if (!channel.ready) return false;
+        return channel.submitted.push(Request{request});
+    }
+
+    void OnMediumChanged(bool, uintptr_t context)
+    {
+        diskcache::Invalidate(context);
+    }
+
+    void FailAllRequests(Unit& unit)
+    {
+        unit.inflight.reset();
+        unit.blockBufferBlock.reset();
+        while(!unit.requests.empty()) {
+            CompleteHead(unit, false);
+        }
+    }
+
+    void FailSubmittedRequests(Channel& channel)
+    {
+        while(auto request = channel.submitted.pop()) {
+            request->Complete(false);
+        }
+    }
+
+    void OnSectorZeroRead(bool success, uintptr_t context)
+    {
+        if (!success || !units[context]) return;
         int n = 0;
-        for(const auto b: transferBuffer) {
+        for(const auto b: units[context]->transferBuffer) {
             printf("%02x ",b);
             ++n;
             if(n == 16) {
@@ -90,25 +486,127 @@ extern "C" void tuh_msc_mount_cb(uint8_t dev_addr)
                 n = 0;
             }
         }
-    } else {
-        printf("umass: unsupported block size, giving up\n");
-        massDevice.reset();
+    }
+
+    void OnCapacityDone(bool success, uintptr_t context)
+    {
+        auto& unit = units[context];
+        if (!unit) return;
+        if (!success) {
+            // I.e. an empty card reader slot; the unit stays until the device is removed
+            printf("umass: unit %d: no medium\n", static_cast<int>(context));
+            return;
+        }
+        const auto block_count = tu_ntohl(unit->capacity.last_lba) + 1;
+        const auto block_size = tu_ntohl(unit->capacity.block_size);
+        printf("umass: unit %d: %" PRIu32 " blocks of %" PRIu32 " bytes, total size %" PRIu32 " MB\n", static_cast<int>(context), block_count, block_size, static_cast<uint32_t>((static_cast<uint64_t>(block_count) * block_size) >> 20));
+        if (block_size >= SectorSize && block_size <= MaxBlockSize && (block_size % SectorSize) == 0) {
+            unit->sectors_per_block = block_size / SectorSize;
+            unit->ready = true;
+            unit->blockBufferBlock.reset();
+            channels[context].ready = true;
+            unit->requests.push(Request{ .op = Operation::Read, .count = 1, .buffer = unit->transferBuffer.data(), .completion = OnSectorZeroRead, .context = context, .local = true });
+        } else {
+            printf("umass: unit %d: unsupported block size, giving up\n", static_cast<int>(context));
+        }
     }
 }
 
-void umass_read_sector(uint32_t sector_nr, uint8_t* buffer)
+extern "C" void tuh_msc_mount_cb(uint8_t dev_addr)
 {
-    massDevice->done = false;
-    tuh_msc_read10(massDevice->dev_addr, massDevice->lun, buffer, sector_nr, 1, msc_callback, 0);
-    massDevice->WaitUntilDone();
+    const auto luns = tuh_msc_get_maxlun(dev_addr);
+    printf("umass: mounted device, address %d, %d LUN(s)\n", dev_addr, luns);
+    for(uint8_t lun = 0; lun < luns; ++lun) {
+        auto unit = std::find_if(units.begin(), units.end(), [](const auto& u) { return !u; });
+        if (unit == units.end()) {
+            printf("umass: ignoring LUN %d of device %d, all units in use\n", lun, dev_addr);
+            break;
+        }
+        const auto unitNr = static_cast<uint8_t>(unit - units.begin());
+        printf("umass: device %d LUN %d is unit %d\n", dev_addr, lun, unitNr);
+        // Anything still submitted was meant for a previous medium
+        FailSubmittedRequests(channels[unitNr]);
+        unit->emplace(dev_addr, lun);
+        Notify(OnMediumChanged, unitNr, true);
+
+        // Bypasses Submit(), as the unit is not ready yet
+        (*unit)->requests.push(Request{ .op = Operation::ReadCapacity, .completion = OnCapacityDone, .context = unitNr, .local = true });
+    }
 }
 
 extern "C" void tuh_msc_umount_cb(uint8_t dev_addr)
 {
-    if (massDevice && massDevice->dev_addr == dev_addr) {
-        printf("umass: unmounted storage device, adress %d\n", dev_addr);
-        massDevice.reset();
-    } else {
-        printf("umass: ignoring unmount of device, adress %d\n", dev_addr);
+    printf("umass: unmounted storage device, adress %d\n", dev_addr);
+    for(size_t unitNr = 0; unitNr < units.size(); ++unitNr) {
+        auto& unit = units[unitNr];
+        if (!unit || unit->dev_addr != dev_addr) continue;
+        channels[unitNr].ready = false;
+        FailAllRequests(*unit);
+        FailSubmittedRequests(channels[unitNr]);
+        Notify(OnMediumChanged, unitNr, true);
+        unit.reset();
+    }
+}
+
+namespace umass
+{
+    bool SubmitRead(uint8_t unit, uint32_t sector_nr, uint32_t count, uint8_t* buffer, Completion completion, uintptr_t context)
+    {
+        return Submit(unit, { .op = Operation::Read, .sector_nr = sector_nr, .count = count, .buffer = buffer, .completion = completion, .context = context });
+    }
+
+    bool SubmitWrite(uint8_t unit, uint32_t sector_nr, uint32_t count, const uint8_t* buffer, Completion completion, uintptr_t context)
+    {
+        // The buffer is only read from; tuh_msc_write10() takes it as const
+        return Submit(unit, { .op = Operation::Write, .sector_nr = sector_nr, .count = count, .buffer = const_cast<uint8_t*>(buffer), .completion = completion, .context = context });
+    }
+
+    bool IsReady(uint8_t unit)
+    {
+        return unit < channels.size() && channels[unit].ready;
     }
-}
\ No newline at end of file
+
+    void Run()
+    {
+        for(size_t n = 0; n < units.size(); ++n) {
+            const auto unitNr = (firstUnit + n) % units.size();
+            if (units[unitNr]) {
+                RunUnit(unitNr);
+            } else {
+                // Submitted just before the unit went away
+                FailSubmittedRequests(channels[unitNr]);
+            }
+        }
+        firstUnit = (firstUnit + 1) % units.size();
+    }
+
+    void RunCompletions()
+    {
+        while(auto notification = notifications.pop()) {
+            notification->completion(notification->success, notification->context);
+        }
+    }
+
+    ReadAheadStatistics GetReadAheadStatistics(uint8_t unit)
+    {
+        if (unit >= channels.size()) return {};
+        mutex_enter_blocking(&statisticsMutex);
+        const auto stats = channels[unit].readAhead;
+        mutex_exit(&statisticsMutex);
+        return stats;
+    }
+
+    QueueStatistics GetSubmissionStatistics(uint8_t unit)
+    {
+        if (unit >= channels.size()) return {};
+        mutex_enter_blocking(&statisticsMutex);
+        const auto stats = channels[unit].submissions;
+        mutex_exit(&statisticsMutex);
+        return stats;
+    }
+
+    QueueStatistics GetCompletionStatistics()
+    {
+        return notifications.statistics();
+    }
+}
@@ -0,0 +1,66 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include "corequeue.h"
+
+namespace umass
+{
+    // Every LUN of every mass storage device is a separate unit, numbered in
+    // the order in which they appear
+    static constexpr auto inline MaxUnits = 4;
+
+    struct ReadAheadStatistics
+    {
+        uint32_t hits{};
+        uint32_t misses{};
+        uint32_t prefetched{};
+        uint32_t discarded{};
+    };
+
+    // Called from umass::RunCompletions() once a request has finished, or
+    // because the device was removed
+    using Completion = void (*)(bool success, uintptr_t context);
+
+    // Queue a transfer from core0; false if there is no usable device or the
+    // queue is full. The buffer must remain valid until the completion is called
+    bool SubmitRead(uint8_t unit, uint32_t sector_nr, uint32_t count, uint8_t* buffer, Completion completion, uintptr_t context);
+    bool SubmitWrite(uint8_t unit, uint32_t sector_nr, uint32_t count, const uint8_t* buffer, Completion completion, uintptr_t context);
+
+    bool IsReady(uint8_t unit);
+
+    // Issues queued requests; call from the core1 loop, next to tuh_task()
+    void Run();
+
+    // Calls completions of finished requests; call from the core0 loop
+    void RunCompletions();
+
+    ReadAheadStatistics GetReadAheadStatistics(uint8_t unit);
+    // Requests waiting to be picked up by core1
+    QueueStatistics GetSubmissionStatistics(uint8_t unit);
+    // Completions waiting to be picked up by core0
+    QueueStatistics GetCompletionStatistics();
+}
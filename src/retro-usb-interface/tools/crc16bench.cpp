@@ -0,0 +1,190 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/*
+ * Times the CRC16_IMPLEMENTATION variants of src/crc16.h over buffers of
+ * whole sectors, as the storage protocol uses them, and reports cycles/byte
+ * per variant. The time is measured, so cycles/byte assumes a clock rate:
+ * the one given with --clock-mhz, else the current one of the first CPU in
+ * /proc/cpuinfo, and it is printed with the results. The figures are those
+ * of the host; they rank the variants, but the RP2040 has no data cache and
+ * takes more cycles per load, so only the ratios carry over. Exits with
+ * status 1 if the variants do not agree on the CRC.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include "crc16bench.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr auto inline SectorSize = 512;
+
+    struct Variant
+    {
+        const char* name;
+        crc16bench::Update update;
+    };
+
+    static constexpr Variant inline Variants[] = {
+        { "0 (bitwise)", crc16bench::Update0 },
+        { "1 (table)", crc16bench::Update1 },
+        { "2 (slice-by-4)", crc16bench::Update2 },
+    };
+
+    struct Options
+    {
+        std::vector<uint32_t> sectors;
+        uint32_t time_ms = 200;
+        uint32_t runs = 5;
+        double clock_mhz = 0;
+    };
+
+    // Current clock of the first CPU, 0 if the kernel does not report it
+    double HostClockMHz()
+    {
+        std::ifstream cpuinfo("/proc/cpuinfo");
+        std::string line;
+        while(std::getline(cpuinfo, line)) {
+            if (line.rfind("cpu MHz", 0) != 0) continue;
+            const auto colon = line.find(':');
+            if (colon != std::string::npos) return strtod(line.c_str() + colon + 1, nullptr);
+        }
+        return 0;
+    }
+
+    // Keeps the compiler from dropping the calculations
+    volatile uint16_t sink;
+
+    // Best of a number of runs, each calling update for about time_ms
+    double MeasureNsPerByte(crc16bench::Update update, const std::vector<uint8_t>& data, const Options& options)
+    {
+        double best = 0;
+        for(uint32_t run = 0; run < options.runs; ++run) {
+            uint64_t calls = 0;
+            uint16_t crc = 0;
+            const auto start = Clock::now();
+            const auto end = start + std::chrono::milliseconds(options.time_ms);
+            auto now = start;
+            do {
+                // Checking the clock per call would dominate small buffers
+                for(int n = 0; n < 16; ++n) crc = update(crc, data.data(), data.size());
+                calls += 16;
+                now = Clock::now();
+            } while(now < end);
+            sink = crc;
+            const auto ns = std::chrono::duration<double, std::nano>(now - start).count() / (calls * data.size());
+            if (run == 0 || ns < best) best = ns;
+        }
+        return best;
+    }
+
+    void Usage(const char* program)
+    {
+        fprintf(stderr,
+            "usage: %s [options]\n"
+            "\n"
+            "  --sectors N     buffer size in sectors, may be repeated (1 and 32)\n"
+            "  --time MS       duration of each run (200)\n"
+            "  --runs N        runs per measurement, the fastest is reported (5)\n"
+            "  --clock-mhz F   clock rate for cycles/byte (from /proc/cpuinfo)\n",
+            program);
+    }
+
+    bool ParseOptions(int argc, char* argv[], Options& options)
+    {
+        enum { Sectors = 256, Time, Runs, ClockMHz };
+        static const option longOptions[] = {
+            { "sectors", required_argument, nullptr, Sectors },
+            { "time", required_argument, nullptr, Time },
+            { "runs", required_argument, nullptr, Runs },
+            { "clock-mhz", required_argument, nullptr, ClockMHz },
+            { nullptr, 0, nullptr, 0 }
+        };
+
+        const auto number = [] { return static_cast<uint32_t>(strtoul(optarg, nullptr, 0)); };
+        int opt;
+        while((opt = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+            switch(opt) {
+                case Sectors: options.sectors.push_back(std::clamp<uint32_t>(number(), 1, 255)); break;
+                case Time: options.time_ms = std::max<uint32_t>(number(), 1); break;
+                case Runs: options.runs = std::max<uint32_t>(number(), 1); break;
+                case ClockMHz: options.clock_mhz = std::max(strtod(optarg, nullptr), 0.0); break;
+                default: return false;
+            }
+        }
+        if (optind != argc) return false;
+        if (options.sectors.empty()) options.sectors = { 1, 32 };
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        Usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const auto source = options.clock_mhz > 0 ? "--clock-mhz" : "/proc/cpuinfo";
+    if (options.clock_mhz == 0) options.clock_mhz = HostClockMHz();
+    if (options.clock_mhz == 0) {
+        fprintf(stderr, "crc16bench: host clock unknown, give it with --clock-mhz\n");
+        return EXIT_FAILURE;
+    }
+    printf("crc16bench: cycles/byte at %.0f MHz (%s)\n", options.clock_mhz, source);
+
+    bool agree = true;
+    for(const auto sectors: options.sectors) {
+        std::vector<uint8_t> data(sectors * SectorSize);
+        std::mt19937 rng{ sectors };
+        std::generate(data.begin(), data.end(), [&] { return static_cast<uint8_t>(rng()); });
+
+        const auto expected = Variants[0].update(0, data.data(), data.size());
+        printf("crc16bench: %u sector(s), %zu bytes\n", sectors, data.size());
+        double bitwise_ns = 0;
+        for(const auto& variant: Variants) {
+            const auto crc = variant.update(0, data.data(), data.size());
+            if (crc != expected) {
+                fprintf(stderr, "crc16bench: variant %s calculates %04x instead of %04x\n", variant.name, crc, expected);
+                agree = false;
+                continue;
+            }
+            const auto ns = MeasureNsPerByte(variant.update, data, options);
+            if (bitwise_ns == 0) bitwise_ns = ns;
+            const auto cycles = ns * options.clock_mhz / 1'000;
+            printf("  variant %-15s %6.2f cycles/byte, %6.3f ns/byte, %8.1f MB/s, %5.1fx bitwise\n",
+                variant.name, cycles, ns, 1'000 / ns, bitwise_ns / ns);
+        }
+    }
+    return agree ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,44 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "crc16bench.h"
+
+// The functions of crc16.h are inline; a namespace per variant keeps them
+// apart when the variants are linked together
+#define CRC16BENCH_CONCAT2(a, b) a##b
+#define CRC16BENCH_CONCAT(a, b) CRC16BENCH_CONCAT2(a, b)
+#define CRC16BENCH_VARIANT CRC16BENCH_CONCAT(variant, CRC16_IMPLEMENTATION)
+
+namespace CRC16BENCH_VARIANT
+{
+#include "crc16.h"
+}
+
+uint16_t crc16bench::CRC16BENCH_CONCAT(Update, CRC16_IMPLEMENTATION)(uint16_t crc, const uint8_t* data, size_t length)
+{
+    return CRC16BENCH_VARIANT::crc16::Update(crc, data, length);
+}
@@ -0,0 +1,193 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/*
+ * Tests of Fifo (src/fifo.h). Besides single-threaded checks of every
+ * operation across the wrap-around, a producer and a consumer thread stress
+ * the queue the way the UART interrupt and the main loop use it. Built with
+ * -fsanitize=thread, so missing ordering between the two sides is reported
+ * even if the data happens to arrive intact.
+ */
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <span>
+#include <thread>
+#include <vector>
+#include "fifo.h"
+
+namespace
+{
+    // Also read by the producer, which gives up once the consumer has
+    std::atomic<int> failures = 0;
+
+    void Check(bool condition, const char* what, size_t detail = 0)
+    {
+        if (condition) return;
+        fprintf(stderr, "fifotest: %s (%zu)\n", what, detail);
+        ++failures;
+    }
+
+    // Elements wider than a word, to catch a consumer seeing half-written ones
+    struct Wide
+    {
+        std::array<uint32_t, 4> words{};
+
+        static Wide Make(uint32_t n) { return { { n, ~n, n * 3, n ^ 0x5a5a5a5a } }; }
+        bool operator==(const Wide&) const = default;
+    };
+
+    // Small, reproducible pseudo-random numbers; one per thread
+    struct Random
+    {
+        uint32_t state;
+
+        uint32_t Next(uint32_t limit)
+        {
+            state = state * 1'664'525 + 1'013'904'223;
+            return (state >> 16) % limit;
+        }
+    };
+
+    void TestWrapAround()
+    {
+        Fifo<8> fifo;
+        Check(fifo.empty() && !fifo.full() && fifo.space_left() == 8, "new FIFO is not empty");
+
+        // Move the indices so that everything below straddles the end of the buffer
+        for(uint8_t n = 0; n < 5; ++n) fifo.push(uint8_t{n});
+        fifo.drop(5);
+
+        for(uint8_t n = 0; n < 8; ++n) Check(fifo.push(uint8_t(10 + n)), "push into a FIFO with room failed", n);
+        Check(fifo.full() && fifo.space_left() == 0, "all elements cannot be used");
+        Check(!fifo.push(uint8_t{99}), "push into a full FIFO succeeded");
+        for(size_t n = 0; n < 8; ++n) Check(fifo.peek(n) == 10 + n, "peek at offset", n);
+
+        std::array<uint8_t, 8> out{};
+        Check(fifo.peek(out, 2) == 6, "peek with offset copied the wrong count");
+        for(size_t n = 0; n < 6; ++n) Check(out[n] == 12 + n, "peek with offset across the end", n);
+        Check(fifo.peek(out, 8) == 0, "peek past the end copied something");
+        Check(fifo.bytes_left() == 8, "peek removed elements");
+
+        Check(fifo.pop() == 10, "pop");
+        Check(fifo.pop(std::span{ out }.first(3)) == 3 && out[0] == 11 && out[2] == 13, "bulk pop across the end");
+        Check(fifo.front() == 14, "front");
+
+        const std::array<uint8_t, 6> more{ 20, 21, 22, 23, 24, 25 };
+        Check(fifo.push(more) == 4, "bulk push stored more than fits");
+        Check(fifo.pop(out) == 8, "bulk pop of a full FIFO");
+        const std::array<uint8_t, 8> expected{ 14, 15, 16, 17, 20, 21, 22, 23 };
+        Check(out == expected, "bulk push across the end");
+        Check(fifo.empty(), "FIFO not empty after popping everything");
+
+        fifo.push(uint8_t{1});
+        fifo.clear();
+        Check(fifo.empty() && fifo.space_left() == 8, "clear");
+    }
+
+    // Producer and consumer use every operation with random sizes; the
+    // consumer checks that it sees the sequence 0..count-1, in order
+    template<size_t Capacity, typename Element, typename Make>
+    void TestThreads(const char* name, uint32_t count, Make make)
+    {
+        Fifo<Capacity, Element> fifo;
+        const int before = failures;
+
+        std::thread producer([&] {
+            Random random{ 1 };
+            std::array<Element, Capacity + 3> values;
+            for(uint32_t next = 0; next < count && failures == before; ) {
+                // Give the consumer a chance on machines with few cores
+                if (fifo.full()) std::this_thread::yield();
+                if (random.Next(2) == 0) {
+                    if (fifo.push(make(next))) ++next;
+                } else {
+                    const auto length = std::min<uint32_t>(1 + random.Next(values.size()), count - next);
+                    for(uint32_t n = 0; n < length; ++n) values[n] = make(next + n);
+                    next += fifo.push(std::span<const Element>{ values.data(), length });
+                }
+            }
+        });
+
+        std::thread consumer([&] {
+            Random random{ 2 };
+            std::array<Element, Capacity + 3> values;
+            uint32_t next = 0;
+            const auto expect = [&](const Element& value) {
+                Check(value == make(next), name, next);
+                ++next;
+            };
+            while(next < count && failures == before) {
+                if (fifo.empty()) std::this_thread::yield();
+                switch(random.Next(4)) {
+                    case 0:
+                        if (!fifo.empty()) expect(fifo.pop());
+                        break;
+                    case 1: {
+                        const auto length = 1 + random.Next(values.size());
+                        const auto popped = fifo.pop(std::span{ values }.first(length));
+                        for(size_t n = 0; n < popped; ++n) expect(values[n]);
+                        break;
+                    }
+                    case 2: {
+                        // Looking ahead must not consume anything
+                        const auto available = fifo.bytes_left();
+                        if (available == 0) break;
+                        const auto offset = random.Next(available);
+                        Check(fifo.peek(offset) == make(next + offset), name, next + offset);
+                        expect(fifo.front());
+                        fifo.drop(1);
+                        break;
+                    }
+                    case 3: {
+                        const auto offset = random.Next(2);
+                        const auto peeked = fifo.peek(values, offset);
+                        for(size_t n = 0; n < peeked; ++n) Check(values[n] == make(next + offset + n), name, next + offset + n);
+                        const auto available = fifo.bytes_left();
+                        const auto dropped = std::min<size_t>(random.Next(Capacity + 1), available);
+                        for(size_t n = 0; n < dropped; ++n) expect(fifo.peek(n));
+                        fifo.drop(dropped);
+                        break;
+                    }
+                }
+            }
+        });
+
+        producer.join();
+        consumer.join();
+        Check(fifo.empty(), "FIFO not empty at the end");
+        printf("fifotest: %s, %lu elements: %s\n", name, static_cast<unsigned long>(count), failures == before ? "ok" : "FAILED");
+    }
+}
+
+int main()
+{
+    TestWrapAround();
+    TestThreads<16, uint8_t>("bytes", 1'000'000, [](uint32_t n) { return static_cast<uint8_t>(n * 7); });
+    TestThreads<8, uint32_t>("words", 1'000'000, [](uint32_t n) { return n; });
+    TestThreads<4, Wide>("wide elements", 500'000, Wide::Make);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
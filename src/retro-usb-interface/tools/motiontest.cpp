@@ -0,0 +1,238 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/*
+ * Replays mouse traces through MotionAccumulator (src/mouse.h) and the
+ * protocol encoders, the way the serial code sends packets: USB reports are
+ * added as they arrive, and a packet is taken whenever the line has room for
+ * one. Checks that
+ *
+ * - every packet fits its protocol, and decodes to the step that was taken;
+ * - no packet moves against the motion that is still pending;
+ * - once everything is sent, the packets add up to the reported motion, with
+ *   less than one step left over (no drift).
+ *
+ * The built-in traces model a 1000Hz high-DPI mouse, whose boot protocol
+ * reports are limited to +/-127 counts. Traces in the format of the host
+ * simulation's --mouse input ("dx dy buttons [wheel]" per line) can be
+ * given on the command line as well.
+ */
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "mouseprotocol.h"
+
+namespace
+{
+    // As used by the serial code
+    static constexpr auto inline CountsPerStep = 2;
+    static constexpr auto inline MaxReport = 127;
+
+    struct Report
+    {
+        int32_t x;
+        int32_t y;
+    };
+
+    struct Trace
+    {
+        std::string name;
+        std::vector<Report> reports;
+    };
+
+    int failures = 0;
+
+    bool Check(bool condition, const std::string& what)
+    {
+        if (!condition) {
+            fprintf(stderr, "motiontest: %s\n", what.c_str());
+            ++failures;
+        }
+        return condition;
+    }
+
+    Report Clamped(double x, double y)
+    {
+        const auto clamp = [](double v) { return static_cast<int32_t>(std::lround(std::clamp(v, -1.0 * MaxReport, 1.0 * MaxReport))); };
+        return { clamp(x), clamp(y) };
+    }
+
+    // A fast flick: speed rises and falls over the trace, up to the report limit
+    Trace Flick(double angle, int length)
+    {
+        Trace trace{ "flick " + std::to_string(static_cast<int>(angle)) + " degrees" };
+        for(int n = 0; n < length; ++n) {
+            const auto speed = MaxReport * 1.3 * std::sin(M_PI * n / length);
+            trace.reports.push_back(Clamped(speed * std::cos(angle * M_PI / 180), speed * std::sin(angle * M_PI / 180)));
+        }
+        return trace;
+    }
+
+    // Slow, diagonal motion of less than a step per report
+    Trace Crawl()
+    {
+        Trace trace{ "crawl" };
+        for(int n = 0; n < 3'000; ++n) trace.reports.push_back({ 1, n % 3 == 0 ? -1 : 0 });
+        return trace;
+    }
+
+    Trace Circle()
+    {
+        Trace trace{ "circle" };
+        for(int n = 0; n < 2'000; ++n) {
+            const auto angle = 2 * M_PI * n / 500;
+            trace.reports.push_back(Clamped(90 * std::cos(angle), 90 * std::sin(angle)));
+        }
+        return trace;
+    }
+
+    // Full speed one way, then straight back
+    Trace Reversal()
+    {
+        Trace trace{ "reversal" };
+        for(int n = 0; n < 300; ++n) trace.reports.push_back({ MaxReport, -MaxReport / 3 });
+        for(int n = 0; n < 300; ++n) trace.reports.push_back({ -MaxReport, MaxReport / 5 });
+        return trace;
+    }
+
+    // Sensor noise around a point must not walk away
+    Trace Jitter()
+    {
+        Trace trace{ "jitter" };
+        uint32_t state = 1;
+        for(int n = 0; n < 5'000; ++n) {
+            state = state * 1'664'525 + 1'013'904'223;
+            const auto dx = static_cast<int32_t>((state >> 16) % 7) - 3;
+            trace.reports.push_back({ dx, -dx });
+            trace.reports.push_back({ -dx, dx });
+        }
+        return trace;
+    }
+
+    bool Load(const char* path, Trace& trace)
+    {
+        std::ifstream in{ path };
+        if (!in) return false;
+        trace.name = path;
+        std::string line;
+        while(std::getline(in, line)) {
+            int x, y;
+            if (sscanf(line.c_str(), "%d %d", &x, &y) == 2) trace.reports.push_back(Clamped(x, y));
+        }
+        return true;
+    }
+
+    int8_t Signed(uint8_t v) { return static_cast<int8_t>(v); }
+
+    // Decodes motion the way the host driver does
+    mouse::MotionAccumulator::Step Decode(mouseprotocol::Microsoft, const mouseprotocol::Bytes& b)
+    {
+        return { Signed(((b[0] & 0b11) << 6) | b[1]), Signed(((b[0] & 0b1100) << 4) | b[2]) };
+    }
+
+    mouse::MotionAccumulator::Step Decode(mouseprotocol::MouseSystems, const mouseprotocol::Bytes& b)
+    {
+        return { Signed(b[1]) + Signed(b[3]), -(Signed(b[2]) + Signed(b[4])) };
+    }
+
+    int Sign(int64_t v) { return (v > 0) - (v < 0); }
+
+    // reportsPerPacket: how many reports arrive while one packet is sent
+    template<typename Encoder>
+    void Replay(const char* protocol, const Trace& trace, int reportsPerPacket)
+    {
+        const auto label = trace.name + ", " + protocol + ", " + std::to_string(reportsPerPacket) + " reports per packet";
+        mouse::MotionAccumulator motion{ CountsPerStep };
+        int64_t reported_x = 0, reported_y = 0;
+        int64_t sent_x = 0, sent_y = 0;
+        size_t packets = 0, largest = 0;
+        const auto before = failures;
+
+        const auto sendPacket = [&] {
+            const auto step = motion.Next(Encoder::MaxStep);
+            // Motion that still has to be sent, in steps
+            const auto pending_x = (reported_x - sent_x * CountsPerStep) / CountsPerStep;
+            const auto pending_y = (reported_y - sent_y * CountsPerStep) / CountsPerStep;
+            Check(std::abs(step.x) <= Encoder::MaxStep && std::abs(step.y) <= Encoder::MaxStep, label + ": step too large");
+            Check(Sign(step.x) * Sign(pending_x) >= 0 && Sign(step.y) * Sign(pending_y) >= 0, label + ": packet moves the wrong way");
+
+            mouseprotocol::Bytes bytes{};
+            Encoder::Encode({ .x = step.x, .y = step.y }, bytes);
+            const auto decoded = Decode(Encoder{}, bytes);
+            Check(decoded.x == step.x && decoded.y == step.y, label + ": packet does not decode to its step");
+
+            motion.Consume(step);
+            sent_x += step.x;
+            sent_y += step.y;
+            largest = std::max<size_t>(largest, std::max(std::abs(step.x), std::abs(step.y)));
+            ++packets;
+        };
+
+        for(size_t n = 0; n < trace.reports.size() && failures == before; ++n) {
+            motion.Add(trace.reports[n].x, trace.reports[n].y);
+            reported_x += trace.reports[n].x;
+            reported_y += trace.reports[n].y;
+            if ((n + 1) % reportsPerPacket == 0 && motion.pending()) sendPacket();
+        }
+        // The mouse stops; the rest goes out
+        for(size_t limit = 0; motion.pending() && limit < 10'000 && failures == before; ++limit) sendPacket();
+
+        Check(!motion.pending(), label + ": motion left after draining");
+        const auto left_x = reported_x - sent_x * CountsPerStep;
+        const auto left_y = reported_y - sent_y * CountsPerStep;
+        Check(std::abs(left_x) < CountsPerStep && std::abs(left_y) < CountsPerStep,
+            label + ": drift of " + std::to_string(left_x) + ", " + std::to_string(left_y) + " counts");
+        if (failures == before) {
+            printf("motiontest: %s: %zu reports, %zu packets of at most %zu steps, sent %lld, %lld steps\n", label.c_str(),
+                trace.reports.size(), packets, largest, static_cast<long long>(sent_x), static_cast<long long>(sent_y));
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<Trace> traces{ Flick(0, 100), Flick(30, 200), Flick(200, 150), Flick(315, 400), Crawl(), Circle(), Reversal(), Jitter() };
+    for(int n = 1; n < argc; ++n) {
+        Trace trace;
+        if (!Load(argv[n], trace)) {
+            perror(argv[n]);
+            return EXIT_FAILURE;
+        }
+        traces.push_back(trace);
+    }
+
+    // At 1000 reports per second: 1200 and 9600 baud, and a packet per report
+    for(const auto reportsPerPacket: { 25, 3, 1 }) {
+        for(const auto& trace: traces) {
+            Replay<mouseprotocol::Microsoft>("Microsoft", trace, reportsPerPacket);
+            Replay<mouseprotocol::MouseSystems>("Mouse Systems", trace, reportsPerPacket);
+        }
+    }
+    printf("motiontest: %s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,35 @@
+#!/bin/sh
+# Checks the mouse latency statistics against the host simulation: motion
+# that is too small to send must not make the next packet look as if it
+# waited for the whole idle time in between.
+#
+#   mouselatencytest.sh path/to/retro-usb-interface-sim
+set -e
+sim=$1
+dir=$(mktemp -d)
+pid=
+trap '[ -n "$pid" ] && kill $pid 2>/dev/null; exec 3>&- 4>&-; rm -rf "$dir"' EXIT
+truncate -s 1M "$dir/disk.img"
+mkfifo "$dir/mouse" "$dir/console"
+
+"$sim" --link "$dir/tty" --mouse "$dir/mouse" "$dir/disk.img" < "$dir/console" > "$dir/sim.log" 2>&1 &
+pid=$!
+exec 3> "$dir/console" 4> "$dir/mouse"
+sleep 1
+
+# A single count stays below the step size; the real move follows a second later
+echo "1 0 0" >&4
+sleep 1
+echo "8 0 0" >&4
+sleep 0.5
+printf l >&3
+sleep 0.5
+
+max=$(sed -n 's/^mouse latency total: .*max \([0-9]*\) us$/\1/p' "$dir/sim.log" | tail -n 1)
+if [ -z "$max" ]; then
+    cat "$dir/sim.log"
+    exit 1
+fi
+echo "mouselatencytest: largest total latency $max us"
+# The idle second must not show up; a packet takes a few ms at 1200 baud
+[ "$max" -lt 200000 ]
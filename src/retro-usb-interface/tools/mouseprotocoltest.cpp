@@ -0,0 +1,140 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/*
+ * Tests of the serial mouse protocol encoders (src/mouseprotocol.h) against
+ * byte streams worked out by hand from the protocol descriptions, the same
+ * ones the Linux sermouse driver decodes.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <initializer_list>
+#include <vector>
+#include "mouseprotocol.h"
+
+namespace
+{
+    using mouseprotocol::Packet;
+    using mouse::ButtonLeft;
+    using mouse::ButtonMiddle;
+    using mouse::ButtonRight;
+
+    int failures = 0;
+
+    void Print(const char* label, const uint8_t* bytes, size_t length)
+    {
+        fprintf(stderr, "  %s:", label);
+        for(size_t n = 0; n < length; ++n) fprintf(stderr, " %02x", bytes[n]);
+        fprintf(stderr, "\n");
+    }
+
+    template<typename Encoder>
+    void Expect(const char* name, const Packet& packet, std::initializer_list<uint8_t> expected)
+    {
+        mouseprotocol::Bytes bytes{};
+        const auto length = Encoder::Encode(packet, bytes);
+        const std::vector<uint8_t> actual(bytes.begin(), bytes.begin() + length);
+        if (actual == std::vector<uint8_t>(expected)) return;
+        fprintf(stderr, "mouseprotocoltest: %s\n", name);
+        Print("expected", std::data(expected), expected.size());
+        Print("actual", actual.data(), actual.size());
+        ++failures;
+    }
+
+    template<typename Encoder>
+    void ExpectFormat(const char* name, std::initializer_list<uint8_t> identification, int dataBits)
+    {
+        const std::vector<uint8_t> actual(Encoder::Identification.begin(), Encoder::Identification.end());
+        if (actual == std::vector<uint8_t>(identification) && Encoder::DataBits == dataBits) return;
+        fprintf(stderr, "mouseprotocoltest: %s identification or data bits\n", name);
+        ++failures;
+    }
+
+    void TestMicrosoft()
+    {
+        using mouseprotocol::Microsoft;
+        ExpectFormat<Microsoft>("Microsoft", { 'M' }, 7);
+        Expect<Microsoft>("Microsoft idle", {}, { 0x40, 0x00, 0x00 });
+        Expect<Microsoft>("Microsoft left, right and down", { .x = 5, .y = -3, .buttons = ButtonLeft }, { 0x6c, 0x05, 0x3d });
+        Expect<Microsoft>("Microsoft right, largest step", { .x = 127, .y = 127, .buttons = ButtonRight }, { 0x55, 0x3f, 0x3f });
+        Expect<Microsoft>("Microsoft largest step left", { .x = -127 }, { 0x42, 0x01, 0x00 });
+        // There is no middle button
+        Expect<Microsoft>("Microsoft middle button", { .buttons = ButtonMiddle }, { 0x40, 0x00, 0x00 });
+    }
+
+    void TestLogitech()
+    {
+        using mouseprotocol::Logitech;
+        ExpectFormat<Logitech>("Logitech", { 'M', '3' }, 7);
+        Expect<Logitech>("Logitech without middle button", { .x = 1, .buttons = ButtonLeft }, { 0x60, 0x01, 0x00 });
+        Expect<Logitech>("Logitech middle press", { .buttons = ButtonMiddle }, { 0x40, 0x00, 0x00, 0x20 });
+        Expect<Logitech>("Logitech middle held", { .x = -2, .buttons = ButtonMiddle | ButtonLeft, .previousButtons = ButtonMiddle },
+            { 0x63, 0x3e, 0x00, 0x20 });
+        // Only the release itself has a 4th byte, which is then 0
+        Expect<Logitech>("Logitech middle release", { .previousButtons = ButtonMiddle }, { 0x40, 0x00, 0x00, 0x00 });
+        Expect<Logitech>("Logitech middle release, left held", { .buttons = ButtonLeft, .previousButtons = ButtonMiddle | ButtonLeft },
+            { 0x60, 0x00, 0x00, 0x00 });
+        Expect<Logitech>("Logitech after middle release", { .y = 1 }, { 0x40, 0x00, 0x01 });
+    }
+
+    void TestIntelliMouse()
+    {
+        using mouseprotocol::IntelliMouse;
+        ExpectFormat<IntelliMouse>("IntelliMouse", { 'M', 'Z', '@' }, 7);
+        // The 4th byte is always sent
+        Expect<IntelliMouse>("IntelliMouse idle", {}, { 0x40, 0x00, 0x00, 0x00 });
+        // USB wheel motion away from the user is negative on the serial line
+        Expect<IntelliMouse>("IntelliMouse wheel away", { .wheel = 1 }, { 0x40, 0x00, 0x00, 0x0f });
+        Expect<IntelliMouse>("IntelliMouse wheel towards", { .wheel = -1 }, { 0x40, 0x00, 0x00, 0x01 });
+        Expect<IntelliMouse>("IntelliMouse wheel away, largest", { .wheel = 7 }, { 0x40, 0x00, 0x00, 0x09 });
+        Expect<IntelliMouse>("IntelliMouse wheel towards, largest", { .wheel = -7 }, { 0x40, 0x00, 0x00, 0x07 });
+        Expect<IntelliMouse>("IntelliMouse middle and wheel", { .x = 3, .y = -1, .wheel = -2, .buttons = ButtonMiddle | ButtonRight },
+            { 0x5c, 0x03, 0x3f, 0x12 });
+    }
+
+    void TestMouseSystems()
+    {
+        using mouseprotocol::MouseSystems;
+        ExpectFormat<MouseSystems>("Mouse Systems", {}, 8);
+        // Buttons are active low
+        Expect<MouseSystems>("Mouse Systems idle", {}, { 0x87, 0x00, 0x00, 0x00, 0x00 });
+        Expect<MouseSystems>("Mouse Systems left", { .buttons = ButtonLeft }, { 0x83, 0x00, 0x00, 0x00, 0x00 });
+        Expect<MouseSystems>("Mouse Systems all buttons", { .buttons = ButtonLeft | ButtonMiddle | ButtonRight }, { 0x80, 0x00, 0x00, 0x00, 0x00 });
+        // Motion is split over two halves, and up is positive
+        Expect<MouseSystems>("Mouse Systems right and up", { .x = 200, .y = -100 }, { 0x87, 100, 50, 100, 50 });
+        Expect<MouseSystems>("Mouse Systems odd counts", { .x = -253, .y = 3 }, { 0x87, 0x82, 0xff, 0x81, 0xfe });
+        Expect<MouseSystems>("Mouse Systems largest step", { .x = 254, .y = -254 }, { 0x87, 127, 127, 127, 127 });
+        Expect<MouseSystems>("Mouse Systems single count", { .x = 1, .y = 1 }, { 0x87, 0x00, 0x00, 0x01, 0xff });
+    }
+}
+
+int main()
+{
+    TestMicrosoft();
+    TestLogitech();
+    TestIntelliMouse();
+    TestMouseSystems();
+    printf("mouseprotocoltest: %s\n", failures == 0 ? "ok" : "FAILED");
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,313 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/*
+ * Benchmarks the storage protocol: reads sectors in a reproducible pattern
+ * and reports throughput, per-request latency and link errors. Works with a
+ * real serial port as well as with the pseudo-terminal of the host
+ * simulation. Exits with status 1 if anything went wrong, so it can also be
+ * used as a regression test (--verify compares with the disk image).
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include "storageclient.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    enum class Pattern { Sequential, Random, Metadata };
+    enum class Mode { Single, Burst, Windowed };
+
+    struct Options
+    {
+        std::string device;
+        Pattern pattern = Pattern::Sequential;
+        Mode mode = Mode::Burst;
+        uint32_t count = 1'024;
+        uint32_t start = 0;
+        uint32_t span = 65'536;
+        uint32_t burst = 32;
+        uint32_t window = 8;
+        bool compress = false;
+        uint8_t rate = 0;
+        uint8_t unit = 0;
+        uint32_t seed = 1;
+        std::string verify;
+        uint32_t offset = 63;
+    };
+
+    // Most reads of a directory walk hit the FAT and directories at the
+    // start of the partition; in between, files are read in short runs
+    static constexpr auto inline MetadataHotSectors = 256;
+    static constexpr auto inline MetadataMaxRun = 8;
+
+    std::vector<uint32_t> MakePattern(const Options& options)
+    {
+        std::vector<uint32_t> sectors;
+        std::mt19937 rng{ options.seed };
+        switch(options.pattern) {
+            case Pattern::Sequential:
+                for(uint32_t n = 0; n < options.count; ++n) sectors.push_back(options.start + n);
+                break;
+            case Pattern::Random:
+                for(uint32_t n = 0; n < options.count; ++n) sectors.push_back(rng() % options.span);
+                break;
+            case Pattern::Metadata: {
+                const auto hot = std::min<uint32_t>(options.span, MetadataHotSectors);
+                while(sectors.size() < options.count) {
+                    if (rng() % 4 != 0 || options.span <= hot) {
+                        sectors.push_back(rng() % hot);
+                        continue;
+                    }
+                    const auto first = hot + rng() % (options.span - hot);
+                    const auto run = 1 + rng() % MetadataMaxRun;
+                    for(uint32_t n = 0; n < run && sectors.size() < options.count; ++n) sectors.push_back(first + n);
+                }
+                break;
+            }
+        }
+        return sectors;
+    }
+
+    struct Run
+    {
+        uint32_t first;
+        uint32_t count;
+        size_t index;
+    };
+
+    // Consecutive sectors become a single request of at most maxCount sectors
+    std::vector<Run> MakeRuns(const std::vector<uint32_t>& sectors, uint32_t maxCount)
+    {
+        std::vector<Run> runs;
+        for(size_t n = 0; n < sectors.size(); ++n) {
+            if (!runs.empty() && runs.back().count < maxCount && runs.back().first + runs.back().count == sectors[n]) {
+                ++runs.back().count;
+            } else {
+                runs.push_back({ sectors[n], 1, n });
+            }
+        }
+        return runs;
+    }
+
+    const char* Describe(Pattern pattern)
+    {
+        switch(pattern) {
+            case Pattern::Sequential: return "sequential";
+            case Pattern::Random: return "random";
+            case Pattern::Metadata: return "metadata";
+        }
+        return "?";
+    }
+
+    uint32_t Percentile(const std::vector<uint32_t>& sorted, uint32_t perMille)
+    {
+        if (sorted.empty()) return 0;
+        const auto index = (sorted.size() * perMille + 999) / 1000;
+        return sorted[std::clamp<size_t>(index, 1, sorted.size()) - 1];
+    }
+
+    void Usage(const char* program)
+    {
+        fprintf(stderr,
+            "usage: %s [options] device\n"
+            "\n"
+            "  --pattern P     sequential, random or metadata (sequential)\n"
+            "  --mode M        single ('R'), burst ('B') or windowed ('r') (burst)\n"
+            "  --count N       number of sectors to read (1024)\n"
+            "  --start N       first sector of the sequential pattern (0)\n"
+            "  --span N        sectors the random and metadata patterns cover (65536)\n"
+            "  --burst N       maximum sectors per 'B' request (32)\n"
+            "  --window N      outstanding windowed requests, 1..8 (8)\n"
+            "  --compress      ask for compressed sector data\n"
+            "  --rate N        highest rate code to negotiate, 0..3 (0)\n"
+            "  --unit N        drive unit (0)\n"
+            "  --seed N        seed of the random patterns (1)\n"
+            "  --verify IMAGE  compare the sectors with a disk image\n"
+            "  --offset N      partition offset within the image (63)\n",
+            program);
+    }
+
+    bool ParseOptions(int argc, char* argv[], Options& options)
+    {
+        enum { PatternOption = 256, ModeOption, Count, Start, Span, Burst, Window, Compress, Rate, Unit, Seed, Verify, Offset };
+        static const option longOptions[] = {
+            { "pattern", required_argument, nullptr, PatternOption },
+            { "mode", required_argument, nullptr, ModeOption },
+            { "count", required_argument, nullptr, Count },
+            { "start", required_argument, nullptr, Start },
+            { "span", required_argument, nullptr, Span },
+            { "burst", required_argument, nullptr, Burst },
+            { "window", required_argument, nullptr, Window },
+            { "compress", no_argument, nullptr, Compress },
+            { "rate", required_argument, nullptr, Rate },
+            { "unit", required_argument, nullptr, Unit },
+            { "seed", required_argument, nullptr, Seed },
+            { "verify", required_argument, nullptr, Verify },
+            { "offset", required_argument, nullptr, Offset },
+            { nullptr, 0, nullptr, 0 }
+        };
+
+        const auto number = [] { return static_cast<uint32_t>(strtoul(optarg, nullptr, 0)); };
+        int opt;
+        while((opt = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+            const std::string arg = optarg ? optarg : "";
+            switch(opt) {
+                case PatternOption:
+                    if (arg == "sequential") options.pattern = Pattern::Sequential;
+                    else if (arg == "random") options.pattern = Pattern::Random;
+                    else if (arg == "metadata") options.pattern = Pattern::Metadata;
+                    else return false;
+                    break;
+                case ModeOption:
+                    if (arg == "single") options.mode = Mode::Single;
+                    else if (arg == "burst") options.mode = Mode::Burst;
+                    else if (arg == "windowed") options.mode = Mode::Windowed;
+                    else return false;
+                    break;
+                case Count: options.count = number(); break;
+                case Start: options.start = number(); break;
+                case Span: options.span = std::max<uint32_t>(number(), 1); break;
+                case Burst: options.burst = std::clamp<uint32_t>(number(), 1, 255); break;
+                case Window: options.window = std::clamp<uint32_t>(number(), 1, 8); break;
+                case Compress: options.compress = true; break;
+                case Rate: options.rate = static_cast<uint8_t>(number()); break;
+                case Unit: options.unit = static_cast<uint8_t>(number()); break;
+                case Seed: options.seed = number(); break;
+                case Verify: options.verify = arg; break;
+                case Offset: options.offset = number(); break;
+                default: return false;
+            }
+        }
+        if (optind + 1 != argc) return false;
+        options.device = argv[optind];
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        Usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    storageclient::SerialPort port;
+    if (!port.Open(options.device)) return EXIT_FAILURE;
+    storageclient::Client client{ port };
+
+    std::optional<uint8_t> capabilities;
+    if (options.mode == Mode::Windowed) capabilities = capabilities.value_or(0) | storageclient::CapabilityWindowed;
+    if (options.compress) capabilities = capabilities.value_or(0) | storageclient::CapabilityCompression;
+    const auto accepted = client.Connect(capabilities);
+    if (!accepted) {
+        fprintf(stderr, "storagebench: no reply to the handshake\n");
+        return EXIT_FAILURE;
+    }
+    if (capabilities && *accepted != *capabilities) {
+        fprintf(stderr, "storagebench: device only accepted capabilities %x of %x\n", *accepted, *capabilities);
+        return EXIT_FAILURE;
+    }
+    uint8_t rate = 0;
+    if (options.rate > 0) {
+        const auto selected = client.SetRate(options.rate);
+        if (!selected) {
+            fprintf(stderr, "storagebench: rate negotiation failed\n");
+            return EXIT_FAILURE;
+        }
+        rate = *selected;
+    }
+    if (options.unit != 0 && !client.SelectUnit(options.unit)) {
+        fprintf(stderr, "storagebench: cannot select unit %u\n", options.unit);
+        return EXIT_FAILURE;
+    }
+
+    const auto sectors = MakePattern(options);
+    std::vector<uint8_t> data(sectors.size() * storageclient::SectorSize);
+    std::vector<uint32_t> latencies_us;
+    const auto receivedBefore = port.received();
+    const auto start = Clock::now();
+    bool ok = true;
+    if (options.mode == Mode::Windowed) {
+        ok = client.ReadWindowed(sectors, data.data(), options.window, latencies_us);
+    } else {
+        for(const auto& run: MakeRuns(sectors, options.mode == Mode::Burst ? options.burst : 1)) {
+            const auto requestStart = Clock::now();
+            ok = client.Read(run.first, static_cast<uint8_t>(run.count), &data[run.index * storageclient::SectorSize]);
+            if (!ok) break;
+            latencies_us.push_back(static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - requestStart).count()));
+        }
+    }
+    const auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    if (!ok) fprintf(stderr, "storagebench: reading failed\n");
+
+    uint32_t mismatches = 0;
+    if (ok && !options.verify.empty()) {
+        const auto fd = open(options.verify.c_str(), O_RDONLY);
+        if (fd < 0) {
+            perror(options.verify.c_str());
+            return EXIT_FAILURE;
+        }
+        std::vector<uint8_t> expected(storageclient::SectorSize);
+        for(size_t n = 0; n < sectors.size(); ++n) {
+            const auto offset = static_cast<off_t>(sectors[n] + options.offset) * storageclient::SectorSize;
+            if (pread(fd, expected.data(), expected.size(), offset) != static_cast<ssize_t>(expected.size()) ||
+                !std::equal(expected.begin(), expected.end(), data.begin() + n * storageclient::SectorSize)) {
+                ++mismatches;
+            }
+        }
+        close(fd);
+    }
+
+    static const char* modes[] = { "single", "burst", "windowed" };
+    const auto modeIndex = static_cast<size_t>(options.mode);
+    printf("storagebench: %s pattern, %s mode, %zu sectors at %lu baud%s in %.2f s\n", Describe(options.pattern), modes[modeIndex],
+        sectors.size(), static_cast<unsigned long>(storageclient::Baudrates[rate]), options.compress ? ", compressed" : "", seconds);
+    printf("  %.1f sectors/s, %.0f bytes/s of sector data, %.0f bytes/s received\n",
+        sectors.size() / seconds, sectors.size() * storageclient::SectorSize / seconds, (port.received() - receivedBefore) / seconds);
+    std::sort(latencies_us.begin(), latencies_us.end());
+    uint64_t total = 0;
+    for(const auto latency: latencies_us) total += latency;
+    printf("  latency of %zu requests: mean %lu us, p50 %lu us, p90 %lu us, p99 %lu us, max %lu us\n", latencies_us.size(),
+        static_cast<unsigned long>(latencies_us.empty() ? 0 : total / latencies_us.size()),
+        static_cast<unsigned long>(Percentile(latencies_us, 500)), static_cast<unsigned long>(Percentile(latencies_us, 900)),
+        static_cast<unsigned long>(Percentile(latencies_us, 990)), static_cast<unsigned long>(latencies_us.empty() ? 0 : latencies_us.back()));
+    const auto& stats = client.statistics();
+    printf("  %lu crc errors, %lu retries, %lu timeouts, %lu device errors", static_cast<unsigned long>(stats.crcErrors),
+        static_cast<unsigned long>(stats.retries), static_cast<unsigned long>(stats.timeouts), static_cast<unsigned long>(stats.deviceErrors));
+    if (!options.verify.empty()) printf(", %lu mismatches", static_cast<unsigned long>(mismatches));
+    printf("\n");
+
+    return ok && mismatches == 0 && stats.crcErrors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,411 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#include "storageclient.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include "compress.h"
+#include "crc16.h"
+
+namespace storageclient
+{
+    namespace
+    {
+        using Clock = std::chrono::steady_clock;
+
+        static constexpr auto inline MouseBaudrate = 1'200;
+        static constexpr auto inline MouseDataBits = 7;
+        // The device replies to the handshake, waits 100ms and then switches
+        static constexpr auto inline HandshakeDelay = std::chrono::milliseconds(150);
+        static constexpr auto inline RateChangeDelay = std::chrono::milliseconds(20);
+        static constexpr auto inline FlushTimeout_ms = 10'000;
+        static constexpr auto inline MaxWindow = 8;
+        static constexpr auto inline MaxAttempts = 4;
+
+        speed_t ToSpeed(uint32_t baudrate)
+        {
+            switch(baudrate) {
+                case 1'200: return B1200;
+                case 115'200: return B115200;
+                case 230'400: return B230400;
+                case 460'800: return B460800;
+                case 921'600: return B921600;
+            }
+            return B0;
+        }
+
+        void PutUint32(uint8_t* p, uint32_t v)
+        {
+            p[0] = v >> 24;
+            p[1] = v >> 16;
+            p[2] = v >> 8;
+            p[3] = v;
+        }
+
+        uint32_t MicrosecondsSince(Clock::time_point start)
+        {
+            return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count());
+        }
+    }
+
+    SerialPort::~SerialPort()
+    {
+        if (fd >= 0) close(fd);
+    }
+
+    bool SerialPort::Open(const std::string& path)
+    {
+        fd = open(path.c_str(), O_RDWR | O_NOCTTY);
+        if (fd < 0) {
+            perror(path.c_str());
+            return false;
+        }
+        return SetBaudrate(Baudrates[0]);
+    }
+
+    bool SerialPort::SetFormat(uint32_t baudrate, int dataBits)
+    {
+        termios t;
+        if (tcgetattr(fd, &t) < 0) return false;
+        cfmakeraw(&t);
+        t.c_cflag &= ~(CSIZE | CSTOPB | PARENB | CRTSCTS);
+        t.c_cflag |= (dataBits == 7 ? CS7 : CS8) | CLOCAL | CREAD;
+        cfsetispeed(&t, ToSpeed(baudrate));
+        cfsetospeed(&t, ToSpeed(baudrate));
+        return tcsetattr(fd, TCSADRAIN, &t) == 0;
+    }
+
+    bool SerialPort::SetBaudrate(uint32_t baudrate)
+    {
+        return SetFormat(baudrate, 8);
+    }
+
+    void SerialPort::DiscardInput()
+    {
+        tcflush(fd, TCIFLUSH);
+    }
+
+    bool SerialPort::Write(std::span<const uint8_t> data)
+    {
+        while(!data.empty()) {
+            const auto n = write(fd, data.data(), data.size());
+            if (n < 0) return false;
+            bytesSent += n;
+            data = data.subspan(n);
+        }
+        return true;
+    }
+
+    bool SerialPort::Read(std::span<uint8_t> data, uint32_t timeout_ms)
+    {
+        const auto deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+        while(!data.empty()) {
+            const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now()).count();
+            pollfd pfd{ .fd = fd, .events = POLLIN };
+            if (left < 0 || poll(&pfd, 1, static_cast<int>(left)) <= 0) return false;
+            const auto n = read(fd, data.data(), data.size());
+            if (n <= 0) return false;
+            bytesReceived += n;
+            data = data.subspan(n);
+        }
+        return true;
+    }
+
+    std::optional<uint8_t> Client::Connect(std::optional<uint8_t> requested)
+    {
+        std::array<uint8_t, 3> request{ '*', '^' };
+        size_t length = 2;
+        if (requested) {
+            request[1] = '~';
+            request[2] = *requested;
+            length = 3;
+        }
+
+        // In mouse mode the port runs at 1200 baud, 7 bits; if the device is
+        // already in storage mode, it runs at 115200 (or whatever was negotiated)
+        for(const auto mouseMode: { true, false }) {
+            if (mouseMode) {
+                port.SetFormat(MouseBaudrate, MouseDataBits);
+            } else {
+                port.SetBaudrate(Baudrates[0]);
+            }
+            port.DiscardInput();
+            port.Write(std::span{ request }.first(length));
+
+            std::array<uint8_t, 3> reply{};
+            // "KO", followed by the capabilities for the extended handshake
+            if (!port.Read(std::span{ reply }.first(length), 500)) continue;
+            if (reply[0] != 'K' || reply[1] != 'O') continue;
+            capabilities = requested ? reply[2] : 0;
+            port.SetBaudrate(Baudrates[0]);
+            std::this_thread::sleep_for(HandshakeDelay);
+            port.DiscardInput();
+            return capabilities;
+        }
+        ++stats.timeouts;
+        return {};
+    }
+
+    std::optional<uint8_t> Client::SetRate(uint8_t maxRate)
+    {
+        uint8_t rates = 0;
+        for(uint8_t rate = 1; rate <= maxRate && rate < std::size(Baudrates); ++rate) {
+            rates |= 1 << (rate - 1);
+        }
+        const std::array<uint8_t, 2> request{ 'S', rates };
+        port.Write(request);
+        std::array<uint8_t, 2> reply;
+        if (!port.Read(reply, timeout_ms)) {
+            ++stats.timeouts;
+            return {};
+        }
+        if (reply[0] != 'K' || reply[1] >= std::size(Baudrates)) return {};
+        port.SetBaudrate(Baudrates[reply[1]]);
+        std::this_thread::sleep_for(RateChangeDelay);
+        return reply[1];
+    }
+
+    bool Client::ReadStatus(uint8_t& status, uint32_t timeout)
+    {
+        if (!port.Read({ &status, 1 }, timeout)) {
+            ++stats.timeouts;
+            return false;
+        }
+        if (status != 'D') return true;
+
+        // Rate fallback: new rate code and the actual status, then switch
+        std::array<uint8_t, 2> rest;
+        if (!port.Read(rest, timeout_ms)) {
+            ++stats.timeouts;
+            return false;
+        }
+        status = rest[1];
+        if (rest[0] < std::size(Baudrates)) {
+            port.SetBaudrate(Baudrates[rest[0]]);
+            std::this_thread::sleep_for(RateChangeDelay);
+        }
+        return true;
+    }
+
+    bool Client::SelectUnit(uint8_t unit)
+    {
+        const std::array<uint8_t, 2> request{ 'U', unit };
+        port.Write(request);
+        uint8_t status;
+        return ReadStatus(status, timeout_ms) && status == 'K';
+    }
+
+    bool Client::ReadSectorData(uint16_t crc, uint8_t* sector, bool& crcOk)
+    {
+        std::array<uint8_t, SectorSize> payload;
+        size_t length = SectorSize;
+        auto format = compress::Format::Raw;
+        if (capabilities & CapabilityCompression) {
+            uint8_t header[3];
+            if (!port.Read({ header, 1 }, timeout_ms)) return false;
+            crc = crc16::Update(crc, header[0]);
+            format = static_cast<compress::Format>(header[0]);
+            if (format == compress::Format::Fill) {
+                length = 1;
+            } else if (format == compress::Format::RLE || format == compress::Format::LZ) {
+                if (!port.Read({ header + 1, 2 }, timeout_ms)) return false;
+                crc = crc16::Update(crc, header + 1, 2);
+                length = std::min<size_t>((header[1] << 8) | header[2], SectorSize);
+            }
+        }
+        std::array<uint8_t, 2> expected;
+        if (!port.Read({ payload.data(), length }, timeout_ms) || !port.Read(expected, timeout_ms)) return false;
+        crc = crc16::Update(crc, payload.data(), length);
+        crcOk = crc == ((expected[0] << 8) | expected[1]);
+
+        if (format == compress::Format::Raw) {
+            memcpy(sector, payload.data(), SectorSize);
+        } else if (crcOk) {
+            crcOk = compress::Decompress(format, payload.data(), length, sector);
+        }
+        return true;
+    }
+
+    bool Client::Read(uint32_t sector, uint8_t count, uint8_t* data, int retries)
+    {
+        const auto send = [&](uint32_t first, uint8_t n) {
+            std::array<uint8_t, 6> request{ static_cast<uint8_t>(n == 1 ? 'R' : 'B') };
+            PutUint32(&request[1], first);
+            request[5] = n;
+            return port.Write(std::span{ request }.first(n == 1 ? 5 : 6));
+        };
+
+        std::vector<uint8_t> bad;
+        send(sector, count);
+        for(uint8_t n = 0; n < count; ++n) {
+            bool crcOk;
+            if (!ReadSectorData(0, data + n * SectorSize, crcOk)) {
+                ++stats.timeouts;
+                return false;
+            }
+            if (!crcOk) {
+                ++stats.crcErrors;
+                bad.push_back(n);
+            }
+        }
+
+        // A sector the device failed to read also arrives with a bad CRC
+        for(const auto n: bad) {
+            for(int attempt = 0; ; ++attempt) {
+                if (attempt == retries) {
+                    ++stats.deviceErrors;
+                    return false;
+                }
+                ++stats.retries;
+                send(sector + n, 1);
+                bool crcOk;
+                if (!ReadSectorData(0, data + n * SectorSize, crcOk)) {
+                    ++stats.timeouts;
+                    return false;
+                }
+                if (crcOk) break;
+                ++stats.crcErrors;
+            }
+        }
+        return true;
+    }
+
+    bool Client::ReadWindowed(std::span<const uint32_t> sectors, uint8_t* data, size_t window, std::vector<uint32_t>& latencies_us)
+    {
+        window = std::clamp<size_t>(window, 1, MaxWindow);
+        struct Outstanding
+        {
+            size_t index;
+            uint8_t seq;
+            Clock::time_point sent;
+            int attempts;
+        };
+        // Replies arrive in the order of the requests, including resends
+        std::deque<Outstanding> expected;
+
+        const auto sendResend = [&](uint8_t seq) {
+            const auto crc = crc16::Update(0, seq);
+            const std::array<uint8_t, 4> request{ 'n', seq, static_cast<uint8_t>(crc >> 8), static_cast<uint8_t>(crc & 0xff) };
+            port.Write(request);
+        };
+        const auto sendRead = [&](uint8_t seq, uint32_t sector) {
+            std::array<uint8_t, 8> request{ 'r', seq };
+            PutUint32(&request[2], sector);
+            const auto crc = crc16::Update(0, &request[1], 5);
+            request[6] = crc >> 8;
+            request[7] = crc & 0xff;
+            port.Write(request);
+        };
+
+        size_t next = 0;
+        uint8_t nextSeq = 0;
+        while(next < sectors.size() || !expected.empty()) {
+            while(next < sectors.size() && expected.size() < window) {
+                const auto seq = nextSeq++;
+                sendRead(seq, sectors[next]);
+                expected.push_back({ next++, seq, Clock::now(), 1 });
+            }
+
+            // 'd' and its sequence number, or 'e' for the oldest request
+            uint8_t reply;
+            if (!port.Read({ &reply, 1 }, timeout_ms)) {
+                ++stats.timeouts;
+                return false;
+            }
+            auto head = expected.front();
+            expected.pop_front();
+            if (reply != 'd' && reply != 'e') {
+                fprintf(stderr, "storageclient: unexpected reply %02x, expected sequence %u\n", reply, head.seq);
+                return false;
+            }
+
+            if (reply == 'd') {
+                uint8_t seq;
+                bool crcOk;
+                if (!port.Read({ &seq, 1 }, timeout_ms) || !ReadSectorData(crc16::Update(0, seq), data + head.index * SectorSize, crcOk)) {
+                    ++stats.timeouts;
+                    return false;
+                }
+                // The CRC covers the sequence number, so it can only differ
+                // if the device mixed up its responses
+                if (crcOk && seq != head.seq) {
+                    fprintf(stderr, "storageclient: reply for sequence %u, expected %u\n", seq, head.seq);
+                    return false;
+                }
+                if (crcOk) {
+                    latencies_us.push_back(MicrosecondsSince(head.sent));
+                    continue;
+                }
+                ++stats.crcErrors;
+            }
+            if (head.attempts == MaxAttempts) {
+                ++stats.deviceErrors;
+                return false;
+            }
+            // A corrupted reply is sent again, a failed or corrupted request must be repeated
+            ++stats.retries;
+            ++head.attempts;
+            if (reply == 'd') {
+                sendResend(head.seq);
+            } else {
+                sendRead(head.seq, sectors[head.index]);
+            }
+            expected.push_back(head);
+        }
+        return true;
+    }
+
+    std::optional<uint8_t> Client::Write(uint32_t sector, const uint8_t* data)
+    {
+        std::array<uint8_t, 1 + 4 + SectorSize + 2> request{ 'W' };
+        PutUint32(&request[1], sector);
+        memcpy(&request[5], data, SectorSize);
+        const auto crc = crc16::Update(0, data, SectorSize);
+        request[5 + SectorSize] = crc >> 8;
+        request[6 + SectorSize] = crc & 0xff;
+        port.Write(request);
+        uint8_t status;
+        if (!ReadStatus(status, timeout_ms)) return {};
+        if (status == 'C') ++stats.crcErrors;
+        return status;
+    }
+
+    std::optional<uint8_t> Client::Flush()
+    {
+        const uint8_t request = 'F';
+        port.Write({ &request, 1 });
+        uint8_t status;
+        if (!ReadStatus(status, FlushTimeout_ms)) return {};
+        return status;
+    }
+}
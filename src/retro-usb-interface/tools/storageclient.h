@@ -0,0 +1,118 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+/*
+ * Host side of the storage protocol described in src/serial.cpp, for use
+ * over a serial device or the pseudo-terminal of the host simulation.
+ * Sector numbers are those of the protocol, i.e. relative to the partition.
+ */
+namespace storageclient
+{
+    static constexpr auto inline SectorSize = 512;
+
+    static constexpr uint8_t inline CapabilityWindowed = 0b0000'0001;
+    static constexpr uint8_t inline CapabilityCompression = 0b0000'0010;
+
+    // Index is the rate code of the 'S' request
+    static constexpr uint32_t inline Baudrates[] = { 115'200, 230'400, 460'800, 921'600 };
+
+    class SerialPort
+    {
+        int fd = -1;
+        uint64_t bytesReceived{};
+        uint64_t bytesSent{};
+
+    public:
+        SerialPort() = default;
+        SerialPort(const SerialPort&) = delete;
+        SerialPort& operator=(const SerialPort&) = delete;
+        ~SerialPort();
+
+        bool Open(const std::string& path);
+        bool SetBaudrate(uint32_t baudrate);
+        bool SetFormat(uint32_t baudrate, int dataBits);
+        // Drops everything received so far
+        void DiscardInput();
+        bool Write(std::span<const uint8_t> data);
+        // False if not all bytes arrived in time
+        bool Read(std::span<uint8_t> data, uint32_t timeout_ms);
+
+        uint64_t received() const { return bytesReceived; }
+        uint64_t sent() const { return bytesSent; }
+    };
+
+    struct ClientStatistics
+    {
+        uint32_t crcErrors{};
+        // Requests that were sent again, after a CRC error or an 'e' reply
+        uint32_t retries{};
+        uint32_t timeouts{};
+        // Sectors the device could not read
+        uint32_t deviceErrors{};
+    };
+
+    class Client
+    {
+        SerialPort& port;
+        uint8_t capabilities{};
+        uint32_t timeout_ms = 2'000;
+        ClientStatistics stats;
+
+        bool ReadStatus(uint8_t& status, uint32_t timeout);
+        // Reads a sector reply after its header; crc covers the header
+        bool ReadSectorData(uint16_t crc, uint8_t* sector, bool& crcOk);
+
+    public:
+        explicit Client(SerialPort& port) : port(port) { }
+
+        // Enters storage mode; with capabilities, the extended handshake is used.
+        // Returns the capabilities the device accepted
+        std::optional<uint8_t> Connect(std::optional<uint8_t> capabilities);
+        // Switches to the highest rate up to maxRate both sides support; returns the rate code
+        std::optional<uint8_t> SetRate(uint8_t maxRate);
+        bool SelectUnit(uint8_t unit);
+
+        // 'R' (count == 1) or 'B'. Sectors that fail their CRC are counted
+        // and read again, up to retries times
+        bool Read(uint32_t sector, uint8_t count, uint8_t* data, int retries = 3);
+        // Windowed reads of the given sectors, with up to window requests
+        // outstanding; latencies_us gets the time from request to reply of each
+        bool ReadWindowed(std::span<const uint32_t> sectors, uint8_t* data, size_t window, std::vector<uint32_t>& latencies_us);
+        // Returns the status byte: 'K', 'C' or 'E'
+        std::optional<uint8_t> Write(uint32_t sector, const uint8_t* data);
+        std::optional<uint8_t> Flush();
+
+        uint8_t accepted_capabilities() const { return capabilities; }
+        const ClientStatistics& statistics() const { return stats; }
+    };
+}
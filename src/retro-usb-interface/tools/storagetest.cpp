@@ -0,0 +1,174 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/*
+ * Regression test of the storage protocol writes, against a device or the
+ * host simulation (see storagetest.sh). Sectors are written so that they all
+ * end up in the same set of the device's write-back cache, which forces
+ * write-back while the writes are in progress.
+ *
+ * With --write-protected, the medium is expected to reject writes: the writes
+ * that fit in the cache succeed, the first one that needs room must be
+ * answered with 'E' instead of hanging the link, and so must the flush.
+ * Reads must keep working afterwards.
+ *
+ * The sectors are overwritten; only use a scratch medium.
+ */
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include "storageclient.h"
+
+namespace
+{
+    // Sectors that are this far apart share a set of the device's cache
+    static constexpr auto inline CacheSets = 16;
+    // More writes than a set has ways
+    static constexpr auto inline WriteCount = 8;
+
+    struct Options
+    {
+        std::string device;
+        uint32_t start = 1'000;
+        bool writeProtected = false;
+    };
+
+    void Fill(uint8_t* sector, uint32_t sector_nr)
+    {
+        for(size_t n = 0; n < storageclient::SectorSize; ++n) {
+            sector[n] = static_cast<uint8_t>(sector_nr * 7 + n);
+        }
+    }
+
+    bool Fail(const char* message)
+    {
+        fprintf(stderr, "storagetest: %s\n", message);
+        return false;
+    }
+
+    bool TestWrites(storageclient::Client& client, const Options& options)
+    {
+        std::array<uint8_t, storageclient::SectorSize> written, read;
+        for(uint32_t n = 0; n < WriteCount; ++n) {
+            const auto sector_nr = options.start + n * CacheSets;
+            Fill(written.data(), sector_nr);
+            const auto status = client.Write(sector_nr, written.data());
+            if (!status) return Fail("no reply to a write");
+            if (*status != 'K') return Fail("write failed");
+        }
+        for(uint32_t n = 0; n < WriteCount; ++n) {
+            const auto sector_nr = options.start + n * CacheSets;
+            Fill(written.data(), sector_nr);
+            if (!client.Read(sector_nr, 1, read.data())) return Fail("reading back failed");
+            if (read != written) return Fail("read back data differs");
+        }
+        const auto status = client.Flush();
+        if (!status) return Fail("no reply to the flush");
+        if (*status != 'K') return Fail("flush failed");
+        printf("storagetest: %d writes, read back and flushed\n", WriteCount);
+        return true;
+    }
+
+    bool TestWriteErrors(storageclient::Client& client, const Options& options)
+    {
+        std::array<uint8_t, storageclient::SectorSize> sector;
+        int accepted = 0, rejected = 0;
+        for(uint32_t n = 0; n < WriteCount; ++n) {
+            const auto sector_nr = options.start + n * CacheSets;
+            Fill(sector.data(), sector_nr);
+            const auto status = client.Write(sector_nr, sector.data());
+            if (!status) return Fail("no reply to a write on a write-protected medium");
+            if (*status == 'K') {
+                ++accepted;
+            } else if (*status == 'E') {
+                ++rejected;
+            } else {
+                return Fail("unexpected write status");
+            }
+        }
+        if (rejected == 0) return Fail("no write was rejected");
+
+        const auto status = client.Flush();
+        if (!status) return Fail("no reply to the flush");
+        if (*status != 'E') return Fail("flush did not fail");
+        if (!client.Read(options.start, 1, sector.data())) return Fail("reading failed after the write errors");
+        printf("storagetest: %d writes cached, %d rejected, flush failed as expected\n", accepted, rejected);
+        return true;
+    }
+
+    void Usage(const char* program)
+    {
+        fprintf(stderr,
+            "usage: %s [options] device\n"
+            "\n"
+            "  --start N           first sector to overwrite (1000)\n"
+            "  --write-protected   expect the medium to reject writes\n",
+            program);
+    }
+
+    bool ParseOptions(int argc, char* argv[], Options& options)
+    {
+        enum { Start = 256, WriteProtected };
+        static const option longOptions[] = {
+            { "start", required_argument, nullptr, Start },
+            { "write-protected", no_argument, nullptr, WriteProtected },
+            { nullptr, 0, nullptr, 0 }
+        };
+
+        int opt;
+        while((opt = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+            switch(opt) {
+                case Start: options.start = static_cast<uint32_t>(strtoul(optarg, nullptr, 0)); break;
+                case WriteProtected: options.writeProtected = true; break;
+                default: return false;
+            }
+        }
+        if (optind + 1 != argc) return false;
+        options.device = argv[optind];
+        return true;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        Usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    storageclient::SerialPort port;
+    if (!port.Open(options.device)) return EXIT_FAILURE;
+    storageclient::Client client{ port };
+    if (!client.Connect({})) {
+        fprintf(stderr, "storagetest: no reply to the handshake\n");
+        return EXIT_FAILURE;
+    }
+
+    const auto ok = options.writeProtected ? TestWriteErrors(client, options) : TestWrites(client, options);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
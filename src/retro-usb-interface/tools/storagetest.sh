@@ -0,0 +1,39 @@
+#!/bin/sh
+# Runs storagetest against the host simulation, once with a writable scratch
+# image and once with the image write-protected:
+#
+#   storagetest.sh path/to/retro-usb-interface-sim path/to/storagetest
+set -e
+sim=$1
+storagetest=$2
+dir=$(mktemp -d)
+pid=
+trap '[ -n "$pid" ] && kill $pid 2>/dev/null; rm -rf "$dir"' EXIT
+truncate -s 4M "$dir/disk.img"
+
+run() {
+    link=$dir/tty$1
+    shift
+    "$sim" --link "$link" "$@" "$dir/disk.img" > "$dir/sim.log" 2>&1 < /dev/null &
+    pid=$!
+    tries=0
+    while [ ! -e "$link" ]; do
+        tries=$((tries + 1))
+        [ $tries -lt 50 ] || { cat "$dir/sim.log"; exit 1; }
+        sleep 0.1
+    done
+}
+
+stop() {
+    kill $pid
+    wait $pid || true
+    pid=
+}
+
+run 0
+"$storagetest" "$link"
+stop
+
+run 1 --read-only
+"$storagetest" --write-protected "$link"
+stop
@@ -0,0 +1,63 @@
+/*-
+ * SPDX-License-Identifier: MIT
+ *
+ * Copyright (c) 2026 Rink Springer
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ */
+/*
+ * Turns the hex trace output of the debug console ('t' until it reports
+ * hex) back into text. Build and use on the host:
+ *
+ *   c++ -std=c++20 -I../src -o tracedecode tracedecode.cpp
+ *   ./tracedecode < console.log
+ *
+ * Lines that are not trace records are passed through unchanged.
+ */
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include "trace.h"
+
+int main()
+{
+    std::array<char, 256> line;
+    while (fgets(line.data(), line.size(), stdin)) {
+        unsigned core;
+        unsigned event;
+        unsigned long timestamp, arg0, arg1, lost;
+        if (sscanf(line.data(), "T %u %lx %x %lx %lx", &core, &timestamp, &event, &arg0, &arg1) == 5) {
+            const trace::Record record{
+                .timestamp_us = static_cast<uint32_t>(timestamp),
+                .event = static_cast<uint16_t>(event),
+                .arg0 = static_cast<uint32_t>(arg0),
+                .arg1 = static_cast<uint32_t>(arg1),
+            };
+            std::array<char, 256> text;
+            trace::Format(text.data(), text.size(), core, record);
+            printf("%s\n", text.data());
+        } else if (sscanf(line.data(), "T! %u %lu", &core, &lost) == 2) {
+            printf("trace: core%u: %lu records lost\n", core, lost);
+        } else {
+            fputs(line.data(), stdout);
+        }
+    }
+    return 0;
+}